@@ -0,0 +1,167 @@
+#ifndef AOT_RUNTIME_H
+#define AOT_RUNTIME_H
+
+#include <chrono>
+#include "sicxe_machine.h"
+
+using namespace std;
+
+// Runtime for programs translated to C++ by translator.cpp. Every basic block
+// becomes a function that returns the address of the next block; addresses
+// without a translated block (computed jumps into the middle of code, code
+// that was overwritten) are run one instruction at a time by the interpreter.
+
+typedef int (*BlockFn)(Machine &);
+
+const int AOT_HALT = -1;  // block ended with "J *"
+const int AOT_ERROR = -2; // block stopped on an error, m.error says why
+
+// translated program as emitted by translator.cpp
+struct Translation
+{
+    int progaddr;        // image the blocks were translated from
+    int length;
+    uint32_t checksum;   // imageChecksum of that image
+    int count;           // number of blocks
+    const int *starts;   // first byte of every block
+    const int *ends;     // one past the last byte of every block
+    const BlockFn *code; // function of every block
+};
+
+inline void setCC(Machine &m, int a, int b)
+{
+    m.reg[REG_SW] = (m.reg[REG_SW] & ~3) | (a < b ? CC_LT : a > b ? CC_GT : CC_EQ);
+}
+
+// FNV-1a over the loaded image, used to check that memory.bin still matches the translation
+inline uint32_t imageChecksum(const Machine &m, int progaddr, int length)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= m.mem[progaddr + i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// load the image, run it through the translated blocks and report like "linkloader -r"
+inline int aot_main(int argc, char *argv[], const Translation &t)
+{
+    string image = "memory.bin";
+    long long limit = 100000000;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+            limit = stoll(argv[++i]);
+        else
+            image = arg;
+    }
+
+    Machine *mp = new Machine();
+    Machine &m = *mp;
+    if (!m.loadOpTab("opTab.dat"))
+    {
+        perror("opTab.dat");
+        exit(1);
+    }
+
+    ImageHeader header;
+    if (!m.loadImage(image, header))
+    {
+        perror(image.c_str());
+        exit(1);
+    }
+
+    // block table indexed by address - progaddr
+    vector<BlockFn> blocks(t.length, (BlockFn)NULL);
+    if ((int)header.progaddr == t.progaddr && (int)header.length == t.length && imageChecksum(m, t.progaddr, t.length) == t.checksum)
+    {
+        for (int i = 0; i < t.count; i++)
+        {
+            blocks[t.starts[i] - t.progaddr] = t.code[i];
+            for (int a = t.starts[i]; a < t.ends[i]; a++)
+                m.codemark[a] |= CODE_TRANSLATED;
+        }
+    }
+    else
+        cerr << image << " does not match the translated image, interpreting" << endl;
+
+    auto begin = chrono::steady_clock::now();
+    int PC = header.execaddr;
+    int result = RUN_HALTED;
+    while (true)
+    {
+        if ((unsigned)PC >= (unsigned)MEMSIZE)
+        {
+            if (PC != HALT_ADDR)
+            {
+                m.error = "jump outside memory";
+                result = RUN_ERROR;
+            }
+            break;
+        }
+        if (m.executed >= limit)
+        {
+            result = RUN_LIMIT;
+            break;
+        }
+
+        BlockFn fn = (PC >= t.progaddr && PC < t.progaddr + t.length) ? blocks[PC - t.progaddr] : NULL;
+        if (fn)
+        {
+            PC = fn(m);
+            if (PC == AOT_HALT)
+                break;
+            if (PC == AOT_ERROR)
+            {
+                result = RUN_ERROR;
+                PC = m.reg[REG_PC];
+                break;
+            }
+        }
+        else
+        {
+            // interpreter fallback, one instruction
+            result = m.run(PC, m.executed + 1);
+            PC = m.reg[REG_PC];
+            if (result != RUN_LIMIT)
+                break;
+            result = RUN_HALTED;
+        }
+
+        // code was overwritten: drop the blocks that cover it
+        if (!m.codeWrites.empty())
+        {
+            for (int addr : m.codeWrites)
+                for (int i = 0; i < t.count; i++)
+                    if (addr >= t.starts[i] && addr < t.ends[i])
+                        blocks[t.starts[i] - t.progaddr] = NULL;
+            m.codeWrites.clear();
+        }
+    }
+    m.reg[REG_PC] = PC;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    if (result == RUN_HALTED)
+        cout << "Program halted" << endl;
+    else if (result == RUN_LIMIT)
+        cout << "Instruction limit reached" << endl;
+    else
+        cout << "Execution error: " << m.error << " at " << hex << uppercase << PC << dec << endl;
+
+    const char *names[] = {"A", "X", "L", "B", "S", "T"};
+    for (int i = 0; i < 6; i++)
+        cout << names[i] << "=" << hex << uppercase << setfill('0') << setw(6) << m.reg[i] << " ";
+    cout << "PC=" << setw(6) << m.reg[REG_PC] << " SW=" << setw(6) << m.reg[REG_SW] << dec << nouppercase << endl;
+    cout << m.executed << " instructions in " << seconds << " s";
+    if (seconds > 0)
+        cout << " (" << m.executed / seconds / 1e6 << " MIPS)";
+    cout << endl;
+
+    delete mp;
+    return result == RUN_ERROR;
+}
+
+#endif /* AOT_RUNTIME_H */
@@ -6,8 +6,11 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <stack>
+#include <sys/stat.h>
+#include "sicxe_memory.h"
 
 using namespace std;
 
@@ -442,12 +445,12 @@ void processLine(string line, Instruction *instr)
     {
         instr->i = 1;
         instr->n = 0;
+        instr->operands.erase(0, 1);
         if (isNumber(instr->operands))
         {
             instr->p = 0;
             instr->b = 0;
         }
-        instr->operands.erase(0, 1);
     }
     // indirect
     else if (temp == '@')
@@ -464,38 +467,317 @@ void processLine(string line, Instruction *instr)
     cout << instr->label << " |" << instr->opcode << " |" << instr->operands << " |" << instr->literal << endl;
 }
 
-int main()
+// macro processor: "NAME MACRO &A,&B" ... "MEND" definitions are expanded while the
+// source is read, every expanded line goes straight to processLine. A body line is
+// kept in DEFTAB as pieces of text and parameter numbers, so an expansion only
+// copies the arguments by index; the expanded text is tokenized again like any
+// other source line. A body word starting with $ becomes a label
+// unique to each expansion ($LOOP -> $0LOOP, $1LOOP, ...).
+struct MacroPiece
 {
-    // Open input and output files
-    ifstream fp1("input.dat");
-    ofstream fp2("intermediate.dat");
+    int param;   // -1: text, -2: unique label prefix, else the parameter number
+    string text;
+};
 
-    // some useful variables' initialisation
-    int LOCCTR = 0, STADDR = 0, LENGTH;
-    string CSECT = "";
+struct MacroDefinition
+{
+    string name;
+    int params;
+    vector<vector<MacroPiece>> body;
+};
 
-    loadOpCodeTable(); // Load opcode table from optab.dat
+vector<MacroDefinition> DEFTAB;
+unordered_map<string, int> NAMTAB; // macro name -> DEFTAB index
 
-    bool flag = false;
-    string line;
+const int MACRO_DEPTH = 32; // deepest expansion of macros calling macros
 
-    // Process each line of the input file
-    while (getline(fp1, line))
+// definition being read: DEFTAB index or -1, MACRO/MEND nesting, parameter names
+int defining = -1, defineLevel = 0;
+vector<string> defineParams;
+
+int macroExpansions = 0, macroLines = 0, macroDepth = 0;
+
+vector<string> splitWords(const string &line)
+{
+    istringstream iss(line);
+    vector<string> words;
+    string word;
+    while (iss >> word)
+        words.push_back(word);
+    return words;
+}
+
+// a body line as text and parameter pieces
+vector<MacroPiece> compileMacroLine(const string &line, const vector<string> &params)
+{
+    vector<MacroPiece> pieces = {{-1, ""}};
+    for (size_t i = 0; i < line.length(); i++)
     {
-        // end of file stop reading
-        if (line.empty())
+        int param = -1;
+        size_t length = 0;
+        if (line[i] == '&')
+        {
+            // the longest parameter name that matches here
+            for (int k = 0; k < (int)params.size(); k++)
+                if (params[k].length() > length && line.compare(i, params[k].length(), params[k]) == 0)
+                {
+                    param = k;
+                    length = params[k].length();
+                }
+        }
+        else if (line[i] == '$' && (i == 0 || !isalnum(line[i - 1])) && i + 1 < line.length() && isalpha(line[i + 1]))
+        {
+            param = -2;
+            length = 1;
+        }
+
+        if (param == -1)
+        {
+            pieces.back().text += line[i];
+            continue;
+        }
+        pieces.push_back({param, ""});
+        pieces.push_back({-1, ""});
+        i += length - 1;
+    }
+    return pieces;
+}
+
+void sourceLine(const string &line, int depth, vector<string> &lines, vector<Instruction> &parsed);
+
+// write the body of a macro with the arguments of a call
+void expandMacro(int index, const string &line, const string &label, const string &operands, int depth,
+                 vector<string> &lines, vector<Instruction> &parsed)
+{
+    const MacroDefinition &macro = DEFTAB[index];
+    if (depth >= MACRO_DEPTH)
+    {
+        cerr << "macro " << macro.name << ": expansion deeper than " << MACRO_DEPTH << endl;
+        exit(1);
+    }
+
+    vector<string> args;
+    stringstream operandStream(operands);
+    string arg;
+    while (getline(operandStream, arg, ','))
+        args.push_back(arg);
+    if ((int)args.size() > macro.params)
+    {
+        cerr << "macro " << macro.name << ": too many arguments\n" << line << endl;
+        exit(1);
+    }
+    args.resize(macro.params);
+
+    // a $ word always continues with a letter, so the digits end where the label starts
+    string unique = "$" + to_string(macroExpansions);
+    macroExpansions++;
+    macroDepth = max(macroDepth, depth + 1);
+
+    // the call stays in the listing as a comment, its label names the first expanded line
+    sourceLine("." + line, depth, lines, parsed);
+    if (label != "")
+        sourceLine(formatString(label, 8) + formatString("EQU", 8) + "*", depth + 1, lines, parsed);
+
+    for (const vector<MacroPiece> &pieces : macro.body)
+    {
+        string text;
+        for (const MacroPiece &piece : pieces)
+            text += piece.param == -1 ? piece.text : piece.param == -2 ? unique : args[piece.param];
+        sourceLine(text, depth + 1, lines, parsed);
+    }
+}
+
+// one source line: stored in a definition, expanded, or tokenized for the passes
+void sourceLine(const string &line, int depth, vector<string> &lines, vector<Instruction> &parsed)
+{
+    vector<string> words = splitWords(line);
+    bool comment = words.empty() || words[0][0] == '.';
+
+    if (defining >= 0)
+    {
+        // nested definitions are kept in the body and defined when it is expanded
+        if (!comment && words.size() >= 2 && words[1] == "MACRO")
+            defineLevel++;
+        else if (!comment && words[0] == "MEND" && --defineLevel == 0)
+        {
+            NAMTAB[DEFTAB[defining].name] = defining;
+            defining = -1;
+            return;
+        }
+        if (!comment)
+            DEFTAB[defining].body.push_back(compileMacroLine(line, defineParams));
+        return;
+    }
+
+    if (!comment && (words.size() == 2 || words.size() == 3) && words[1] == "MACRO")
+    {
+        defineParams.clear();
+        if (words.size() == 3)
+        {
+            stringstream paramStream(words[2]);
+            string param;
+            while (getline(paramStream, param, ','))
+                defineParams.push_back(param);
+        }
+        DEFTAB.push_back({words[0], (int)defineParams.size(), {}});
+        defining = DEFTAB.size() - 1;
+        defineLevel = 1;
+        return;
+    }
+    if (!comment && words[0] == "MEND")
+    {
+        cerr << "MEND without MACRO" << endl;
+        exit(1);
+    }
+
+    if (!comment && words.size() <= 3)
+    {
+        string label = words.size() == 3 ? words[0] : "";
+        string name = words.size() == 3 ? words[1] : words[0];
+        string operands = words.size() >= 2 ? words.back() : "";
+        auto macro = NAMTAB.find(name);
+        if (macro != NAMTAB.end())
+        {
+            expandMacro(macro->second, line, label, operands, depth, lines, parsed);
+            return;
+        }
+    }
+
+    if (depth > 0)
+        macroLines++;
+    Instruction instr;
+    processLine(line, &instr);
+    lines.push_back(line);
+    parsed.push_back(instr);
+}
+
+// external references of the current CSECT
+set<string> EXTREF;
+
+// format 3 operand that may have to be widened to format 4, or was widened already
+struct Reference
+{
+    int line;      // index of the source line
+    string CSECT;
+    int PC;        // address of the next instruction
+    string symbol; // operand symbol, literal or immediate number
+    bool literal;
+    bool external; // EXTREF, resolved by the loader
+    string base;   // operand of the last BASE directive in the CSECT, "" if none
+};
+
+// address of a symbol or literal operand after the last pass, -1 if it has none
+int targetAddress(const Reference &ref)
+{
+    map<SYMBOL, VALUE> &table = ref.literal ? LITTAB : SYMTAB;
+    auto it = table.find(SYMBOL(ref.CSECT, ref.symbol));
+    if (ref.external || isNumber(ref.symbol) || it == table.end())
+        return -1;
+    return it->second.getValue();
+}
+
+// whether the operand still fits format 3 with the addresses of the last pass, same rules as pass 2
+bool fits(const Reference &ref)
+{
+    if (ref.external)
+        return false;
+    if (isNumber(ref.symbol))
+        return stoi(ref.symbol) <= 4095;
+
+    int target = targetAddress(ref);
+    if (target < 0)
+        return true;
+    if (target - ref.PC >= -2048 && target - ref.PC <= 2047)
+        return true;
+
+    auto base = SYMTAB.find(SYMBOL(ref.CSECT, ref.base));
+    if (!ref.base.empty() && base != SYMTAB.end())
+        return target - base->second.getValue() >= 0 && target - base->second.getValue() <= 4095;
+    return false;
+}
+
+// source line with a "+" in front of the opcode, keeping the operand column where possible
+string extendLine(string line, string opcode)
+{
+    size_t pos = 0;
+    while (pos < line.length())
+    {
+        size_t start = line.find_first_not_of(" \t", pos);
+        if (start == string::npos)
             break;
+        size_t end = line.find_first_of(" \t", start);
+        if (end == string::npos)
+            end = line.length();
+        if (line.substr(start, end - start) == opcode)
+        {
+            line.insert(start, "+");
+            if (end + 2 < line.length() && line[end + 1] == ' ' && line[end + 2] == ' ')
+                line.erase(end + 1, 1);
+            return line;
+        }
+        pos = end;
+    }
+    return line;
+}
 
-        Instruction instr;
-        processLine(line, &instr);
+// place the literals of CSECT that have no address yet at LOCCTR
+void placeLiterals(ostream &fp2, int &LOCCTR, const string &CSECT)
+{
+    for (auto &x : LITTAB)
+    {
+        if (x.first.getCSECT() == CSECT && x.second.getValue() == -1)
+        {
+            // write to intermediate file
+            fp2 << formatNumber(LOCCTR, 4) << "\t" << formatString("*", 6) << "\t\t=" << formatString(x.first.getName(), 6) << '\n';
+
+            // Update literal address
+            x.second.setValue(LOCCTR);
+
+            // Update LOCCTR according to the literal type
+            if (x.first.getName().front() == 'C')
+                LOCCTR += (x.first.getName().length() - 3);
+            else if (x.first.getName().front() == 'X')
+                LOCCTR += ((x.first.getName().length() - 3) / 2);
+            else
+                LOCCTR += 3;
+        }
+    }
+}
+
+// one pass over the source: addresses, SYMTAB and LITTAB, intermediate lines into fp2
+// format 3 operands that relaxation may have to widen are collected in refs
+void assemble(const vector<string> &lines, const vector<Instruction> &parsed, const set<int> &extended, ostream &fp2, vector<Reference> &refs)
+{
+    // some useful variables' initialisation
+    int LOCCTR = 0, STADDR = 0, LENGTH;
+    string CSECT = "", BASE = "";
+
+    SYMTAB.clear();
+    LITTAB.clear();
+    EXTREF.clear();
+
+    for (int index = 0; index < (int)lines.size(); index++)
+    {
+        string line = lines[index];
+        Instruction instr = parsed[index];
+
+        // widened by relaxation
+        if (extended.count(index))
+        {
+            instr.e = 1;
+            instr.p = 0;
+            instr.b = 0;
+            line = extendLine(line, instr.opcode);
+        }
 
         if (instr.label != ".")
         {
             if (instr.opcode == "START" || instr.opcode == "CSECT")
             {
-                // enter the previous CSECT in the SYMTAB
+                // enter the previous CSECT in the SYMTAB, its literals without LTORG go at its end
                 if (!CSECT.empty())
                 {
+                    placeLiterals(fp2, LOCCTR, CSECT);
                     LENGTH = LOCCTR - STADDR;
                     SYMTAB.insert({SYMBOL(CSECT, CSECT), VALUE(STADDR, LENGTH)});
                 }
@@ -508,6 +790,8 @@ int main()
 
                 LOCCTR = STADDR;
                 CSECT = instr.label;
+                BASE = "";
+                EXTREF.clear();
 
                 // initialize some symbols for the csection
                 preprocess(CSECT);
@@ -523,25 +807,7 @@ int main()
                 // fp2 << formatString("", 4) << "\t\t\t\t" << formatString(instr.opcode, 6) << "\t\t" << formatString(instr.operands, 6) << "\n";
 
                 // Update LITTAB
-                for (auto &x : LITTAB)
-                {
-                    if (x.second.getValue() == -1)
-                    {
-                        // write to intermediate file
-                        fp2 << formatNumber(LOCCTR, 4) << "\t" << formatString("*", 6) << "\t\t=" << formatString(x.first.getName(), 6) << '\n';
-
-                        // Update literal address
-                        x.second.setValue(LOCCTR);
-
-                        // Update LOCCTR according to the literal type
-                        if (x.first.getName().front() == 'C')
-                            LOCCTR += (x.first.getName().length() - 3);
-                        else if (x.first.getName().front() == 'X')
-                            LOCCTR += ((x.first.getName().length() - 3) / 2);
-                        else
-                            LOCCTR += 3;
-                    }
-                }
+                placeLiterals(fp2, LOCCTR, CSECT);
 
                 // enter the last CSECT in the SYMTAB
                 if (instr.opcode == "END")
@@ -550,8 +816,10 @@ int main()
                     SYMTAB.insert({SYMBOL(CSECT, CSECT), VALUE(STADDR, LENGTH)});
                 }
             }
-            else if (instr.opcode == "BASE")
+            else if (instr.opcode == "BASE" || instr.opcode == "NOBASE")
             {
+                BASE = instr.opcode == "BASE" ? instr.operands : "";
+
                 // write to intermediate file
                 fp2 << formatNumber(LOCCTR, 4) << "\t" << line << "\n";
                 // fp2 << formatNumber(LOCCTR, 4) << "\t" << formatString(instr.label, 6) << "\t\t" << formatString(instr.opcode, 6) << "\t\t" << formatString(instr.operands, 6) << "\n";
@@ -616,6 +884,14 @@ int main()
             }
             else if (instr.opcode == "EXTDEF" || instr.opcode == "EXTREF")
             {
+                if (instr.opcode == "EXTREF")
+                {
+                    stringstream operands(instr.operands);
+                    string symbol;
+                    while (getline(operands, symbol, ','))
+                        EXTREF.insert(symbol);
+                }
+
                 // write to intermediate file
                 fp2 << formatString("", 4) << "\t" << line << "\n";
                 // fp2 << "\t\t\t\t\t" << formatString(instr.opcode, 6) << "\t\t" << formatString(instr.operands, 6) << "\n";
@@ -659,6 +935,13 @@ int main()
 
                     instr.length = format.first;
                     LOCCTR += instr.length;
+
+                    // format 3 operand: check after the pass whether it fits
+                    if ((instr.length == 3 || extended.count(index)) && instr.operands != "")
+                    {
+                        string symbol = instr.operands.substr(0, instr.operands.find(','));
+                        refs.push_back({index, CSECT, LOCCTR, symbol, instr.literal, EXTREF.count(symbol) > 0, BASE});
+                    }
                 }
                 else if (instr.opcode == "WORD")
                     LOCCTR += 3;
@@ -673,6 +956,22 @@ int main()
                     if (instr.operands.front() == 'X')
                         LOCCTR += ((instr.operands.length() - 3) / 2);
                 }
+                else if (instr.opcode == "INCBIN")
+                {
+                    // the bytes of the file, only its size is needed here
+                    struct stat st;
+                    if (stat(instr.operands.c_str(), &st) < 0)
+                    {
+                        perror(instr.operands.c_str());
+                        exit(1);
+                    }
+                    if (LOCCTR + st.st_size > MEMSIZE)
+                    {
+                        cerr << instr.operands << ": does not fit in memory" << endl;
+                        exit(1);
+                    }
+                    LOCCTR += st.st_size;
+                }
                 else
                 {
                     perror("Invalid Operation Code\n");
@@ -688,6 +987,681 @@ int main()
         }
     }
 
+}
+
+// program blocks: "USE name" continues block name of the CSECT, "USE" the default
+// block. Every block has its own location counter, and the blocks follow each other
+// at the end of the CSECT in the order they first appear. With all lines in memory
+// this is the same as moving the lines of every block together, so the passes see
+// one sequence per CSECT and assign the block-relocated addresses directly.
+// The USE lines stay as comments. Returns the number of named blocks.
+int groupBlocks(vector<string> &lines, vector<Instruction> &parsed)
+{
+    vector<string> newLines;
+    vector<Instruction> newParsed;
+    vector<string> order;               // blocks of the CSECT in order of appearance
+    map<string, vector<int>> blockLines; // lines of every block
+    string block = "";
+    int blocks = 0;
+
+    auto flush = [&]()
+    {
+        for (const string &name : order)
+            for (int i : blockLines[name])
+            {
+                newLines.push_back(lines[i]);
+                newParsed.push_back(parsed[i]);
+            }
+        order.clear();
+        blockLines.clear();
+        block = "";
+    };
+
+    for (int i = 0; i < (int)lines.size(); i++)
+    {
+        Instruction &instr = parsed[i];
+        if (instr.label != "." && (instr.opcode == "START" || instr.opcode == "CSECT" || instr.opcode == "END"))
+        {
+            flush();
+            newLines.push_back(lines[i]);
+            newParsed.push_back(instr);
+            continue;
+        }
+
+        if (instr.label != "." && instr.opcode == "USE")
+        {
+            block = instr.operands;
+            if (block != "" && !blockLines.count(block))
+                blocks++;
+            lines[i] = "." + lines[i];
+            instr = Instruction(".");
+        }
+        if (!blockLines.count(block))
+            order.push_back(block);
+        blockLines[block].push_back(i);
+    }
+    flush();
+
+    lines = newLines;
+    parsed = newParsed;
+    return blocks;
+}
+
+// bytes of a literal as hex digits, "" if the literal has no known form
+string literalBytes(string name)
+{
+    if (isNumber(name))
+        return formatNumber(stoi(name) & 0xFFFFFF, 6);
+    if (name.length() < 3 || name[1] != '\'' || name.back() != '\'')
+        return "";
+
+    string constant = name.substr(2, name.length() - 3);
+    string bytes = "";
+    if (name.front() == 'C')
+        for (char ch : constant)
+            bytes += formatNumber((unsigned char)ch, 2);
+    else if (name.front() == 'X' && constant.length() % 2 == 0 && all_of(constant.begin(), constant.end(), ::isxdigit))
+        for (char ch : constant)
+            bytes += toupper(ch);
+    return bytes;
+}
+
+// literals that hold exactly the operand of the instruction become immediates:
+// 3 byte literals of word operations, 1 byte literals of byte operations, if the
+// value fits the 20 bit address field (relaxation widens it past 4095). The other
+// literals of a CSECT are merged by content, so =C'A' and =X'41' share an entry.
+void promoteLiterals(vector<string> &lines, vector<Instruction> &parsed)
+{
+    static const set<string> wordOps = {"LDA", "LDX", "LDL", "LDB", "LDS", "LDT", "ADD", "SUB", "MUL", "DIV", "COMP", "AND", "OR", "TIX"};
+    static const set<string> byteOps = {"LDCH", "RD", "WD", "TD"};
+
+    map<string, string> first; // literal bytes -> first literal with them in this CSECT
+    set<string> before, after; // pool entries (CSECT, literal) without and with the changes
+    int promoted = 0, merged = 0, beforeBytes = 0, afterBytes = 0;
+    string CSECT = "";
+    for (int i = 0; i < (int)parsed.size(); i++)
+    {
+        Instruction &instr = parsed[i];
+        if (instr.label == ".")
+            continue;
+        if (instr.opcode == "START" || instr.opcode == "CSECT")
+        {
+            CSECT = instr.label;
+            first.clear();
+        }
+        if (!instr.literal || instr.operands.find(',') != string::npos)
+            continue;
+
+        string name = instr.operands;
+        string bytes = literalBytes(name);
+        if (bytes.empty())
+            continue;
+        if (before.insert(CSECT + " " + name).second)
+            beforeBytes += bytes.length() / 2;
+
+        int length = bytes.length() / 2;
+        int value = stoi(bytes.substr(0, min(length, 3) * 2), nullptr, 16);
+        if (((length == 3 && wordOps.count(instr.opcode)) || (length == 1 && byteOps.count(instr.opcode))) && value < (1 << 20))
+        {
+            instr.literal = false;
+            instr.operands = to_string(value);
+            instr.i = 1;
+            instr.n = 0;
+            instr.p = 0;
+            instr.b = 0;
+            lines[i].replace(lines[i].find("=" + name), name.length() + 1, "#" + instr.operands);
+            promoted++;
+            continue;
+        }
+
+        auto it = first.find(bytes);
+        if (it == first.end())
+            first[bytes] = name;
+        else if (it->second != name)
+        {
+            instr.operands = it->second;
+            lines[i].replace(lines[i].find("=" + name), name.length() + 1, "=" + it->second);
+            merged++;
+        }
+        if (after.insert(CSECT + " " + instr.operands).second)
+            afterBytes += length;
+    }
+    cout << "literals: " << promoted << " promoted to immediates, " << merged << " merged, pools " << beforeBytes << " -> " << afterBytes << " bytes" << endl;
+}
+
+// relaxation: every instruction starts in format 3 and is widened to format 4 only
+// when its operand can't be reached PC or BASE relative; widening moves the later
+// addresses, so repeat until no instruction is widened. Returns the operands of the last pass.
+vector<Reference> relax(const vector<string> &lines, const vector<Instruction> &parsed, set<int> &extended, ostringstream &intermediate, int &passes)
+{
+    extended.clear();
+    passes = 0;
+    while (true)
+    {
+        vector<Reference> refs;
+        intermediate.str("");
+        assemble(lines, parsed, extended, intermediate, refs);
+        passes++;
+
+        int widened = 0;
+        for (Reference &ref : refs)
+            if (!fits(ref) && extended.insert(ref.line).second)
+                widened++;
+        if (!widened)
+            return refs;
+    }
+}
+
+// CSECT of every source line
+vector<string> lineSections(const vector<Instruction> &parsed)
+{
+    vector<string> sections;
+    string CSECT = "";
+    for (const Instruction &instr : parsed)
+    {
+        if (instr.label != "." && (instr.opcode == "START" || instr.opcode == "CSECT"))
+            CSECT = instr.label;
+        sections.push_back(CSECT);
+    }
+    return sections;
+}
+
+// bytes and format 4 relocations (M records) of a CSECT after the last pass
+pair<int, int> sectionSize(const vector<Instruction> &parsed, const set<int> &extended, const string &CSECT)
+{
+    vector<string> sections = lineSections(parsed);
+    int relocations = 0;
+    for (int i = 0; i < (int)parsed.size(); i++)
+        if (sections[i] == CSECT && opCodeTable.count(parsed[i].opcode) && (parsed[i].e || extended.count(i)) &&
+            parsed[i].operands != "" && !isNumber(parsed[i].operands))
+            relocations++;
+    return {SYMTAB[SYMBOL(CSECT, CSECT)].getLength(), relocations};
+}
+
+// whether an instruction may change register B
+bool writesBase(const Instruction &instr)
+{
+    if (instr.opcode == "LDB")
+        return true;
+    if (OPTAB(instr.opcode).first != 2 || instr.opcode == "COMPR" || instr.opcode == "TIXR")
+        return false;
+    for (string reg : Instruction(instr).getOperands())
+        if (reg == "B")
+            return true;
+    return false;
+}
+
+// source line without its label, the other columns stay in place
+string removeLabel(string line, string label)
+{
+    size_t pos = line.find(label);
+    if (pos != string::npos)
+        line.replace(pos, label.length(), string(label.length(), ' '));
+    return line;
+}
+
+// automatic BASE placement: in every CSECT pick the label whose 4096 byte window covers
+// the most operands out of PC reach, then load B with it at every point where B may be
+// stale (CSECT entry, END entry, EXTDEF'd labels, after each JSUB). A CSECT keeps the placement only if it
+// gets smaller, or equally long with fewer relocations. Results go to baseReport.dat.
+void placeBase(vector<string> &lines, vector<Instruction> &parsed, set<int> &extended, ostringstream &intermediate, int &passes)
+{
+    ofstream report("baseReport.dat");
+    vector<Reference> refs = relax(lines, parsed, extended, intermediate, passes);
+
+    // B belongs to the program if any CSECT sets it; callees loading B would clobber it
+    for (int i = 0; i < (int)parsed.size(); i++)
+        if (parsed[i].label != "." && (parsed[i].opcode == "BASE" || parsed[i].opcode == "NOBASE" || writesBase(parsed[i])))
+        {
+            report << "register B is set by the program (" << lines[i] << "), no BASE placed" << endl;
+            return;
+        }
+
+    string entry = "";
+    for (const Instruction &instr : parsed)
+        if (instr.label != "." && instr.opcode == "END")
+            entry = instr.operands;
+
+    vector<string> sectionNames;
+    for (const string &CSECT : lineSections(parsed))
+        if (sectionNames.empty() || sectionNames.back() != CSECT)
+            sectionNames.push_back(CSECT);
+
+    int bytesSaved = 0, relocationsSaved = 0;
+    for (const string &CSECT : sectionNames)
+    {
+        if (CSECT.empty())
+            continue;
+        report << CSECT << ": ";
+
+        // targets out of PC reach
+        vector<int> targets;
+        for (Reference &ref : refs)
+            if (ref.CSECT == CSECT && !fits(ref) && targetAddress(ref) >= 0)
+                targets.push_back(targetAddress(ref));
+        if (targets.empty())
+        {
+            report << "every operand fits PC relative or is external" << endl;
+            continue;
+        }
+
+        // label with the most targets in [label, label + 4095]
+        string best = "";
+        int bestCount = 0;
+        for (auto &symbol : SYMTAB)
+        {
+            if (symbol.first.getCSECT() != CSECT || symbol.first.getName() == CSECT || !symbol.second.getType())
+                continue;
+            int base = symbol.second.getValue(), count = 0;
+            for (int target : targets)
+                if (target - base >= 0 && target - base <= 4095)
+                    count++;
+            if (count > bestCount)
+            {
+                best = symbol.first.getName();
+                bestCount = count;
+            }
+        }
+        if (best.empty())
+        {
+            report << targets.size() << " operands out of PC reach, no label covers them" << endl;
+            continue;
+        }
+
+        // other CSECTs may call any label named in EXTDEF
+        vector<string> sections = lineSections(parsed);
+        set<string> exported;
+        for (int i = 0; i < (int)parsed.size(); i++)
+            if (parsed[i].label != "." && sections[i] == CSECT && parsed[i].opcode == "EXTDEF")
+            {
+                stringstream names(parsed[i].operands);
+                string name;
+                while (getline(names, name, ','))
+                    exported.insert(name);
+            }
+
+        // LDB #best and BASE best at the CSECT entry, the END entry, every EXTDEF'd
+        // label and after every JSUB. B is stale at all of them, so after the first
+        // one a NOBASE keeps the LDB itself from being assembled BASE relative.
+        vector<string> newLines;
+        vector<Instruction> newParsed;
+        bool entered = false;
+        int loads = 0;
+        auto loadBase = [&](const string &label)
+        {
+            if (entered)
+            {
+                newLines.push_back(formatString("", 12) + "NOBASE");
+                newParsed.push_back(Instruction("", "NOBASE"));
+            }
+            Instruction load(label, "LDB", best);
+            load.n = 0;
+            newLines.push_back(formatString(label, 12) + formatString("LDB", 12) + "#" + best);
+            newParsed.push_back(load);
+            newLines.push_back(formatString("", 12) + formatString("BASE", 12) + best);
+            newParsed.push_back(Instruction("", "BASE", best));
+            entered = true;
+            loads++;
+        };
+        for (int i = 0; i < (int)lines.size(); i++)
+        {
+            string line = lines[i];
+            Instruction instr = parsed[i];
+            bool code = instr.label != "." && sections[i] == CSECT && opCodeTable.count(instr.opcode);
+            if (code && (!entered || (instr.label != "" && (instr.label == entry || exported.count(instr.label)))))
+            {
+                loadBase(instr.label);
+                if (instr.label != "")
+                    line = removeLabel(line, instr.label);
+                instr.label = "";
+            }
+            newLines.push_back(line);
+            newParsed.push_back(instr);
+            if (code && instr.opcode == "JSUB")
+                loadBase("");
+        }
+
+        pair<int, int> before = sectionSize(parsed, extended, CSECT);
+        set<int> newExtended;
+        ostringstream newIntermediate;
+        int newPasses;
+        vector<Reference> newRefs = relax(newLines, newParsed, newExtended, newIntermediate, newPasses);
+        pair<int, int> after = sectionSize(newParsed, newExtended, CSECT);
+
+        report << "BASE " << best << " covers " << bestCount << " of " << targets.size() << " operands out of PC reach, "
+               << loads << " LDB, " << before.first << " -> " << after.first << " bytes, "
+               << before.second << " -> " << after.second << " relocations";
+        if (after.first < before.first || (after.first == before.first && after.second < before.second))
+        {
+            report << endl;
+            bytesSaved += before.first - after.first;
+            relocationsSaved += before.second - after.second;
+            lines = newLines;
+            parsed = newParsed;
+            extended = newExtended;
+            intermediate.str(newIntermediate.str());
+            passes = newPasses;
+            refs = newRefs;
+        }
+        else
+        {
+            report << ", not placed" << endl;
+            relax(lines, parsed, extended, intermediate, passes);
+        }
+    }
+    report << "saved " << bytesSaved << " bytes and " << relocationsSaved << " relocations" << endl;
+    report.close();
+}
+
+// format 4 instructions of a CSECT after the last pass
+int format4Count(const vector<Instruction> &parsed, const set<int> &extended, const string &CSECT)
+{
+    vector<string> sections = lineSections(parsed);
+    int count = 0;
+    for (int i = 0; i < (int)parsed.size(); i++)
+        if (sections[i] == CSECT && opCodeTable.count(parsed[i].opcode) && (parsed[i].e || extended.count(i)))
+            count++;
+    return count;
+}
+
+// lines of a CSECT in the given chunk order, the rest of the program unchanged
+void arrange(const vector<string> &lines, const vector<Instruction> &parsed, int begin, int end, const vector<vector<int>> &chunks,
+             const vector<int> &order, vector<string> &newLines, vector<Instruction> &newParsed)
+{
+    newLines.assign(lines.begin(), lines.begin() + begin);
+    newParsed.assign(parsed.begin(), parsed.begin() + begin);
+    for (int c : order)
+        for (int i : chunks[c])
+        {
+            newLines.push_back(lines[i]);
+            newParsed.push_back(parsed[i]);
+        }
+    newLines.insert(newLines.end(), lines.begin() + end, lines.end());
+    newParsed.insert(newParsed.end(), parsed.begin() + end, parsed.end());
+}
+
+const int LAYOUT_TRIALS = 10000; // chunk orders relaxed per CSECT before the layout search stops
+
+// code layout: split every CSECT into chunks that can move without changing what the
+// program does (a code chunk runs up to its J or RSUB, a data chunk is a labelled
+// WORD/BYTE/RESW/RESB with the unlabelled data and EQUs after it, LTORG is a chunk of
+// its own; chunks read past by TAB,X or TAB+3 are glued together) and move chunks while
+// that lowers the number of format 4 instructions, then the bytes. The chunk with the
+// CSECT entry stays first. Results go to layoutReport.dat.
+void layoutSections(vector<string> &lines, vector<Instruction> &parsed)
+{
+    static const set<string> dataOps = {"WORD", "BYTE", "RESW", "RESB", "INCBIN"};
+    ofstream report("layoutReport.dat");
+    int format4Saved = 0, relocationsSaved = 0, bytesSaved = 0;
+
+    for (int header = 0; header < (int)parsed.size(); header++)
+    {
+        if (parsed[header].label == "." || (parsed[header].opcode != "START" && parsed[header].opcode != "CSECT"))
+            continue;
+        string CSECT = parsed[header].label;
+        report << CSECT << ": ";
+
+        // region from the first code or data line to the next CSECT or END
+        int begin = header + 1;
+        while (begin < (int)parsed.size() && (parsed[begin].label == "." || parsed[begin].opcode == "EXTDEF" || parsed[begin].opcode == "EXTREF"))
+            begin++;
+        int end = begin;
+        while (end < (int)parsed.size() && !(parsed[end].label != "." && (parsed[end].opcode == "CSECT" || parsed[end].opcode == "END")))
+            end++;
+
+        // chunks; comments go with the line after them
+        vector<vector<int>> chunks;
+        map<string, int> chunkOf; // label -> chunk
+        vector<int> pending;
+        bool open = false, pinned = false;
+        for (int i = begin; i < end; i++)
+        {
+            const Instruction &instr = parsed[i];
+            if (instr.label == ".")
+            {
+                pending.push_back(i);
+                continue;
+            }
+            if (instr.opcode == "BASE" || instr.opcode == "NOBASE")
+            {
+                pinned = true;
+                break;
+            }
+
+            // a new chunk starts unless the code before falls into this line
+            bool code = opCodeTable.count(instr.opcode) > 0;
+            bool start = chunks.empty();
+            if (!start && !open)
+            {
+                string last = parsed[chunks.back().back()].opcode;
+                start = code || instr.opcode == "LTORG" || (last == "LTORG" && instr.opcode != "EQU") || (dataOps.count(instr.opcode) && instr.label != "");
+            }
+            if (start)
+                chunks.push_back(vector<int>());
+            chunks.back().insert(chunks.back().end(), pending.begin(), pending.end());
+            pending.clear();
+            chunks.back().push_back(i);
+            if (instr.label != "")
+                chunkOf[instr.label] = chunks.size() - 1;
+
+            // code that does not end in J or RSUB falls into whatever comes next
+            open = code && instr.opcode != "J" && instr.opcode != "RSUB";
+        }
+        if (!chunks.empty())
+            chunks.back().insert(chunks.back().end(), pending.begin(), pending.end());
+        else if (!pending.empty())
+            chunks.push_back(pending);
+
+        // an indexed operand (TAB,X) or an offset (TAB+3) may read past its label into the
+        // chunk after it (before it for TAB-3), so those chunks move as one
+        vector<bool> glued(chunks.size(), false); // chunk c stays followed by chunk c + 1
+        bool keepLast = false;                    // the last chunk reads past the end and stays last
+        for (int i = begin; i < end && !pinned; i++)
+        {
+            const Instruction &instr = parsed[i];
+            if (instr.label == "." || instr.opcode == "BYTE" || instr.operands.empty())
+                continue;
+            bool indexed = instr.operands.find(",X") != string::npos, offset = false;
+            vector<string> tokens = evalExpression(CSECT).tokenize(instr.operands.substr(0, instr.operands.find(',')));
+            for (string token : tokens)
+                if (isNumber(token))
+                    offset = true;
+            if (!indexed && !offset)
+                continue;
+            bool backwards = offset && find(tokens.begin(), tokens.end(), "-") != tokens.end();
+            for (string token : tokens)
+                if (chunkOf.count(token))
+                {
+                    int c = chunkOf[token];
+                    if (c + 1 < (int)chunks.size())
+                        glued[c] = true;
+                    else
+                        keepLast = true;
+                    if (backwards && c > 0)
+                        glued[c - 1] = true;
+                }
+        }
+        vector<vector<int>> merged;
+        vector<int> mergedOf(chunks.size());
+        for (int c = 0; c < (int)chunks.size(); c++)
+        {
+            if (c == 0 || !glued[c - 1])
+                merged.push_back(vector<int>());
+            merged.back().insert(merged.back().end(), chunks[c].begin(), chunks[c].end());
+            mergedOf[c] = merged.size() - 1;
+        }
+        for (auto &label : chunkOf)
+            label.second = mergedOf[label.second];
+        chunks = merged;
+
+        // expressions over labels of different chunks would change value
+        for (int i = begin; i < end && !pinned; i++)
+        {
+            const Instruction &instr = parsed[i];
+            if (instr.label == "." || instr.opcode == "BYTE" || instr.operands.find_first_of("+-*/") == string::npos)
+                continue;
+            set<int> used;
+            for (string token : evalExpression(CSECT).tokenize(instr.operands.substr(0, instr.operands.find(','))))
+                if (chunkOf.count(token))
+                    used.insert(chunkOf[token]);
+            if (used.size() > 1)
+                pinned = true;
+        }
+        if (pinned || chunks.size() < 3)
+        {
+            report << (pinned ? "BASE directive or expression across chunks, not moved" : "nothing to move") << endl;
+            continue;
+        }
+
+        // the search relaxes this CSECT alone: its lines and an END, chunks renumbered to match
+        vector<string> sectionLines(lines.begin() + header, lines.begin() + end);
+        vector<Instruction> sectionParsed(parsed.begin() + header, parsed.begin() + end);
+        sectionLines.push_back(formatString("", 12) + "END");
+        sectionParsed.push_back(Instruction("", "END"));
+        vector<vector<int>> sectionChunks = chunks;
+        for (vector<int> &chunk : sectionChunks)
+            for (int &i : chunk)
+                i -= header;
+
+        set<int> extended;
+        ostringstream intermediate;
+        int passes;
+        relax(sectionLines, sectionParsed, extended, intermediate, passes);
+        pair<int, int> start = {format4Count(sectionParsed, extended, CSECT), SYMTAB[SYMBOL(CSECT, CSECT)].getLength()};
+        int startRelocations = sectionSize(sectionParsed, extended, CSECT).second;
+
+        // move one chunk at a time to the place where it helps most, until nothing improves
+        vector<int> order;
+        for (int c = 0; c < (int)chunks.size(); c++)
+            order.push_back(c);
+        pair<int, int> best = start;
+        vector<string> newLines;
+        vector<Instruction> newParsed;
+        bool improved = true;
+        int trials = 0, movable = chunks.size() - (keepLast ? 1 : 0);
+        for (int round = 0; improved && round < 4 && trials < LAYOUT_TRIALS; round++)
+        {
+            improved = false;
+            for (int c = 1; c < movable && trials < LAYOUT_TRIALS; c++)
+            {
+                vector<int> rest = order;
+                rest.erase(find(rest.begin(), rest.end(), c));
+                vector<int> bestOrder = order;
+                for (int pos = 1; pos <= (int)rest.size() - (keepLast ? 1 : 0) && trials < LAYOUT_TRIALS; pos++)
+                {
+                    vector<int> trial = rest;
+                    trial.insert(trial.begin() + pos, c);
+                    if (trial == order)
+                        continue;
+                    trials++;
+                    arrange(sectionLines, sectionParsed, begin - header, end - header, sectionChunks, trial, newLines, newParsed);
+                    relax(newLines, newParsed, extended, intermediate, passes);
+                    pair<int, int> cost = {format4Count(newParsed, extended, CSECT), SYMTAB[SYMBOL(CSECT, CSECT)].getLength()};
+                    if (cost < best)
+                    {
+                        best = cost;
+                        bestOrder = trial;
+                        improved = true;
+                    }
+                }
+                order = bestOrder;
+            }
+        }
+
+        arrange(sectionLines, sectionParsed, begin - header, end - header, sectionChunks, order, newLines, newParsed);
+        relax(newLines, newParsed, extended, intermediate, passes);
+        int relocations = sectionSize(newParsed, extended, CSECT).second;
+        arrange(lines, parsed, begin, end, chunks, order, newLines, newParsed);
+
+        if (trials >= LAYOUT_TRIALS)
+            report << "search stopped after " << trials << " orders, ";
+        report << chunks.size() << " chunks, format 4 " << start.first << " -> " << best.first << ", M records " << startRelocations << " -> "
+               << relocations << ", bytes " << start.second << " -> " << best.second << ", order";
+        for (int c : order)
+            report << " " << (parsed[chunks[c].front()].label == "." || parsed[chunks[c].front()].label == "" ? to_string(chunks[c].front() + 1) : parsed[chunks[c].front()].label);
+        report << endl;
+
+        format4Saved += start.first - best.first;
+        relocationsSaved += startRelocations - relocations;
+        bytesSaved += start.second - best.second;
+        lines = newLines;
+        parsed = newParsed;
+    }
+    report << "avoided " << format4Saved << " format 4 instructions and " << relocationsSaved << " M records, saved " << bytesSaved << " bytes" << endl;
+    report.close();
+}
+
+int main(int argc, char *argv[])
+{
+    // -base places LDB/BASE pairs automatically, -layout reorders code and data
+    // chunks, the source file defaults to input.dat
+    bool autoBase = false, layout = false;
+    string input = "input.dat";
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-base")
+            autoBase = true;
+        else if (arg == "-layout")
+            layout = true;
+        else if (arg[0] != '-')
+            input = arg;
+        else
+        {
+            cerr << "usage: " << argv[0] << " [-base] [-layout] [source]" << endl;
+            exit(1);
+        }
+    }
+
+    // Open input and output files
+    ifstream fp1(input);
+    ofstream fp2("intermediate.dat");
+    if (!fp1.is_open())
+    {
+        perror(input.c_str());
+        exit(1);
+    }
+
+    loadOpCodeTable(); // Load opcode table from optab.dat
+
+    // read and tokenize the whole source once, every pass works on these lines
+    vector<string> lines;
+    vector<Instruction> parsed;
+    string line;
+    while (getline(fp1, line))
+    {
+        // end of file stop reading
+        if (line.empty())
+            break;
+
+        sourceLine(line, 0, lines, parsed);
+    }
+    if (defining >= 0)
+    {
+        cerr << "macro " << DEFTAB[defining].name << ": MACRO without MEND" << endl;
+        exit(1);
+    }
+    cout << "macros: " << DEFTAB.size() << " defined, " << macroExpansions << " calls expanded to " << macroLines
+         << " lines, depth " << macroDepth << endl;
+
+    int blocks = groupBlocks(lines, parsed);
+    if (blocks)
+        cout << "program blocks: " << blocks << " named blocks placed after the default block" << endl;
+
+    promoteLiterals(lines, parsed);
+    if (layout)
+        layoutSections(lines, parsed);
+
+    set<int> extended;
+    ostringstream intermediate;
+    int passes = 0;
+    if (autoBase)
+        placeBase(lines, parsed, extended, intermediate, passes);
+    else
+        relax(lines, parsed, extended, intermediate, passes);
+    cout << "relaxation: " << extended.size() << " instructions widened to format 4 in " << passes << " passes" << endl;
+    fp2 << intermediate.str();
+
     // closing files
     fp1.close();
     fp2.close();
@@ -8,6 +8,10 @@
 #include <map>
 #include <algorithm>
 #include <stack>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -511,12 +515,12 @@ int processLine(string line, Instruction *instr)
     {
         instr->i = 1;
         instr->n = 0;
+        instr->operands.erase(0, 1);
         if (isNumber(instr->operands))
         {
             instr->p = 0;
             instr->b = 0;
         }
-        instr->operands.erase(0, 1);
     }
     // indirect
     else if (temp == '@')
@@ -538,8 +542,184 @@ int processLine(string line, Instruction *instr)
     return -1;
 }
 
-int main()
+// machine code of one line, or the bytes of an INCBIN file that stay mapped until
+// the T records are written and only then are turned into hex
+struct ObjectCode
+{
+    int address;
+    string hex;                 // object code in hex, empty for a file
+    const unsigned char *bytes; // mapped file, NULL for hex
+    int size;                   // bytes of the mapped file
+};
+
+// map an INCBIN file, it stays mapped until the program exits
+ObjectCode includeBinary(int address, const string &file)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        perror(file.c_str());
+        exit(1);
+    }
+
+    ObjectCode code = {address, "", NULL, (int)st.st_size};
+    if (st.st_size > 0)
+    {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            perror(file.c_str());
+            exit(1);
+        }
+        code.bytes = (const unsigned char *)data;
+    }
+    close(fd);
+    return code;
+}
+
+// hex of n bytes
+string hexBytes(const unsigned char *bytes, int n)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    string hex(2 * n, '0');
+    for (int i = 0; i < n; i++)
+    {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 15];
+    }
+    return hex;
+}
+
+// T records from the machine code of a CSECT: the code is sorted by address and
+// cut only where the addresses have a gap (RESW, RESB) or a record is full. A
+// record is written as soon as it is full, so at most one record of hex is held
+// and a mapped file is converted one record at a time.
+vector<string> packText(vector<ObjectCode> code, int maxBytes)
+{
+    stable_sort(code.begin(), code.end(), [](const ObjectCode &a, const ObjectCode &b)
+                { return a.address < b.address; });
+
+    vector<string> records;
+    int START = 0;
+    string text = "";
+    auto flush = [&]()
+    {
+        records.push_back("T" + formatNumber(START, 6) + formatNumber(text.length() / 2, 2) + text);
+        START += text.length() / 2;
+        text = "";
+    };
+    for (const ObjectCode &piece : code)
+    {
+        // a gap ends the record
+        if (text.length() && piece.address != START + (int)text.length() / 2)
+            flush();
+        if (text.empty())
+            START = piece.address;
+
+        if (piece.bytes == NULL)
+            for (int at = 0; at < (int)piece.hex.length(); at += 2)
+            {
+                text += piece.hex.substr(at, 2);
+                if ((int)text.length() == 2 * maxBytes)
+                    flush();
+            }
+        else
+            for (int at = 0; at < piece.size;)
+            {
+                int n = min(piece.size - at, maxBytes - (int)text.length() / 2);
+                text += hexBytes(piece.bytes + at, n);
+                at += n;
+                if ((int)text.length() == 2 * maxBytes)
+                    flush();
+            }
+    }
+    if (text.length())
+        flush();
+    return records;
+}
+
+// compact relocation: M records that add the CSECT's own address to a 20 bit field
+// become one bit per byte in a B record per T record ("B" start mask, the bit of a
+// byte is set when a 05 field starts in its low half). Consecutive M records for
+// the same field length, sign and symbol are merged into one M record that lists
+// more addresses after the symbol.
+void compactRelocations(const string &CSECT, const vector<string> &texts, vector<string> &modifications, vector<string> &bitmasks)
+{
+    const int GROUP = 10; // addresses per M record
+    string self = "05+" + formatString(CSECT, 6);
+
+    vector<int> relative;
+    vector<string> external;
+    for (string record : modifications)
+    {
+        if (record.substr(7, 9) == self)
+            relative.push_back(stoi(record.substr(1, 6), nullptr, 16));
+        else
+            external.push_back(record);
+    }
+
+    set<int> covered;
+    for (string text : texts)
+    {
+        int start = stoi(text.substr(1, 6), nullptr, 16);
+        int length = stoi(text.substr(7, 2), nullptr, 16);
+        vector<int> bits((length + 3) / 4 * 4, 0);
+        bool any = false;
+        for (int address : relative)
+            if (address >= start && address < start + length)
+            {
+                bits[address - start] = 1;
+                covered.insert(address);
+                any = true;
+            }
+        if (!any)
+            continue;
+
+        stringstream mask;
+        mask << "B" << formatNumber(start, 6);
+        for (int i = 0; i < (int)bits.size(); i += 4)
+            mask << formatNumber(bits[i] * 8 + bits[i + 1] * 4 + bits[i + 2] * 2 + bits[i + 3], 1);
+        bitmasks.push_back(mask.str());
+    }
+
+    // fixups outside the text records stay M records
+    for (int address : relative)
+        if (!covered.count(address))
+            external.push_back("M" + formatNumber(address, 6) + self);
+
+    modifications.clear();
+    for (int i = 0; i < (int)external.size();)
+    {
+        string record = external[i];
+        int j = i + 1;
+        while (j < (int)external.size() && j - i < GROUP && external[j].substr(7, 9) == record.substr(7, 9))
+            record += external[j++].substr(1, 6);
+        modifications.push_back(record);
+        i = j;
+    }
+}
+
+int main(int argc, char *argv[])
 {
+    // -bitmask writes program relative relocations as B records and groups M records
+    // -t sets the most bytes of a T record (1 to 255)
+    bool bitmask = false;
+    int TEXTMAX = 30;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-bitmask")
+            bitmask = true;
+        else if (arg == "-t" && i + 1 < argc && stoi(argv[i + 1]) >= 1 && stoi(argv[i + 1]) <= 255)
+            TEXTMAX = stoi(argv[++i]);
+        else
+        {
+            cerr << "usage: " << argv[0] << " [-bitmask] [-t bytes]" << endl;
+            exit(1);
+        }
+    }
+
     // Open intermediate, output and listing files
     ifstream fp1("intermediate.dat");
     ofstream fp2("output.dat");
@@ -552,11 +732,12 @@ int main()
     }
 
     // useful variables' initialisation
-    int LOCCTR = 0, BASE = 0, PC = 0, START = 0;
-    string CSECT = "", PROGNAME = "", text = "";
+    int LOCCTR = 0, BASE = -1, PC = 0; // BASE -1: no BASE directive in this CSECT
+    string CSECT = "", PROGNAME = "";
 
     // for record storing
     map<string, vector<string>> text_list, modification_list;
+    map<string, vector<ObjectCode>> code_list; // object code of every CSECT
     map<string, string> header_list, end_list, define_list, refer_list;
     vector<string> CSECTS;
 
@@ -627,22 +808,6 @@ int main()
                 // write listing for the instruction
                 fp3 << line << endl;
 
-                // write the left over output machine code of the previous CSECT
-                if (text.length())
-                {
-                    int LENGTH = (text.length()) / 2;
-                    stringstream text_record;
-                    text_record << "T";
-                    text_record << formatNumber(START, 6);
-                    text_record << formatNumber(LENGTH, 2);
-                    text_record << text;
-
-                    text_list[CSECT].push_back(text_record.str());
-
-                    text = "";
-                    START = 0;
-                }
-
                 stringstream end;
                 end << "E";
                 end_list.insert({CSECT, end.str()});
@@ -650,6 +815,7 @@ int main()
                 // starting address, length of the new CSECT
                 int STADDR = 0;
                 CSECT = instr.label;
+                BASE = -1;
                 CSECTS.push_back(CSECT);
 
                 int LENGTH = 0;
@@ -708,6 +874,24 @@ int main()
                 if (SYMTAB.find(SYMBOL(CSECT, instr.operands)) != SYMTAB.end())
                     BASE = SYMTAB[SYMBOL(CSECT, instr.operands)].getValue();
             }
+            else if (instr.opcode == "NOBASE")
+            {
+                // write listing for the instruction
+                fp3 << line << endl;
+
+                // no BASE relative addressing until the next BASE directive
+                BASE = -1;
+            }
+            else if (instr.opcode == "INCBIN")
+            {
+                ObjectCode file = includeBinary(LOCCTR, instr.operands);
+
+                // write listing for the instruction, only the first bytes of the file
+                fp3 << line << "\t" << formatString(hexBytes(file.bytes, min(file.size, 4)) + (file.size > 4 ? "..." : ""), 10) << endl;
+
+                if (file.size)
+                    code_list[CSECT].push_back(file);
+            }
             else if (instr.opcode == "LTORG")
             {
                 // write listing for the instruction
@@ -779,7 +963,7 @@ int main()
                                         // decide between PC relative and base relative
                                         if (operandcode - PC >= -2048 && operandcode - PC <= 2047)
                                             operandcode -= PC;
-                                        else if (operandcode - BASE >= 0 && operandcode - BASE <= 4095)
+                                        else if (BASE >= 0 && operandcode - BASE >= 0 && operandcode - BASE <= 4095)
                                         {
                                             operandcode -= BASE;
                                             instr.p = 0;
@@ -791,7 +975,8 @@ int main()
                                             exit(1);
                                         }
                                     }
-                                    if (instr.e)
+                                    // only a relative address moves with the CSECT
+                                    if (instr.e && SYMTAB[SYMBOL(CSECT, m_operands.front())].getType())
                                     {
                                         stringstream modification;
                                         modification << "M";
@@ -830,7 +1015,7 @@ int main()
                                     {
                                         if (operandcode - PC >= -2048 && operandcode - PC <= 2047)
                                             operandcode -= PC;
-                                        else if (operandcode - BASE >= 0 && operandcode - BASE <= 4095)
+                                        else if (BASE >= 0 && operandcode - BASE >= 0 && operandcode - BASE <= 4095)
                                         {
                                             operandcode -= BASE;
                                             instr.p = 0;
@@ -842,6 +1027,16 @@ int main()
                                             exit(1);
                                         }
                                     }
+
+                                    if (instr.e)
+                                    {
+                                        stringstream modification;
+                                        modification << "M";
+                                        modification << formatNumber(LOCCTR + 1, 6);
+                                        modification << "05+";
+                                        modification << formatString(CSECT, 6);
+                                        modification_list[CSECT].push_back(modification.str());
+                                    }
                                 }
                                 else
                                 {
@@ -865,7 +1060,7 @@ int main()
                                         // decide between PC relative and BASE relative
                                         if (operandcode - PC >= -2048 && operandcode - PC <= 2047)
                                             operandcode -= PC;
-                                        else if (operandcode - BASE >= 0 && operandcode - BASE <= 4095)
+                                        else if (BASE >= 0 && operandcode - BASE >= 0 && operandcode - BASE <= 4095)
                                         {
                                             operandcode -= BASE;
                                             instr.p = 0;
@@ -878,7 +1073,8 @@ int main()
                                         }
                                     }
 
-                                    if (instr.e)
+                                    // an absolute symbol, such as an EQU constant, is not relocated
+                                    if (instr.e && SYMTAB[SYMBOL(CSECT, instr.operands)].getType())
                                     {
                                         stringstream modification;
                                         modification << "M";
@@ -1001,64 +1197,40 @@ int main()
                     fp3 << line << "\t" << formatString(obcode, 10) << endl;
                 }
 
-                // write the output machine code
-                if (text.length() == 0)
-                    START = LOCCTR;
-
-                if (text.length() + obcode.length() <= 60 && instr.opcode != "RESW" && instr.opcode != "RESB")
-                    text += obcode;
-                else
-                {
-                    if (text.length())
-                    {
-                        int LENGTH = (text.length()) / 2;
-                        stringstream text_record;
-                        text_record << "T";
-                        text_record << formatNumber(START, 6);
-                        text_record << formatNumber(LENGTH, 2);
-                        text_record << text;
-
-                        text_list[CSECT].push_back(text_record.str());
-
-                        text = obcode;
-                        START = LOCCTR;
-                    }
-                }
+                // keep the machine code, the T records are packed at the end
+                if (obcode.length())
+                    code_list[CSECT].push_back({LOCCTR, obcode, NULL, 0});
             }
         }
         else
             fp3 << line << endl;
     }
 
-    if (text.length())
-    {
-        int LENGTH = (text.length()) / 2;
-        stringstream text_record;
-        text_record << "T";
-        text_record << formatNumber(START, 6);
-        text_record << formatNumber(LENGTH, 2);
-        text_record << text;
-
-        text_list[CSECT].push_back(text_record.str());
-
-        text = "";
-        START = 0;
-    }
-
+    int records = 0;
     for (string CSECT : CSECTS)
     {
+        text_list[CSECT] = packText(code_list[CSECT], TEXTMAX);
+        records += text_list[CSECT].size();
+
         fp2 << header_list[CSECT] << endl;
         if (!define_list[CSECT].empty())
             fp2 << define_list[CSECT] << endl;
         if (!refer_list[CSECT].empty())
             fp2 << refer_list[CSECT] << endl;
+        vector<string> bitmask_list;
+        if (bitmask)
+            compactRelocations(CSECT, text_list[CSECT], modification_list[CSECT], bitmask_list);
         for (string text_record : text_list[CSECT])
             fp2 << text_record << endl;
+        for (string bitmask_record : bitmask_list)
+            fp2 << bitmask_record << endl;
         for (string modification_record : modification_list[CSECT])
             fp2 << modification_record << endl;
         fp2 << end_list[CSECT] << endl;
     }
 
+    cout << records << " T records of at most " << TEXTMAX << " bytes" << endl;
+
     // closing files
     fp1.close();
     fp2.close();
@@ -0,0 +1,452 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cerrno>
+#include "sicxe_machine.h"
+
+using namespace std;
+
+// Links and runs every program of a manifest on a pool of worker threads.
+// Each worker owns one Machine that is reset between programs, so programs
+// never see each other's memory, registers or devices. Jobs are dealt to the
+// workers in contiguous runs; a worker takes from the back of its own queue
+// and steals from the front of the others' once its queue is empty.
+
+// one line of the manifest
+struct Job
+{
+    string name;
+    int progaddr;
+    long long limit;
+    vector<string> objects;   // object programs, linked in this order
+    map<int, string> devices; // input device -> file
+};
+
+// exit state and outputs of a job
+struct Result
+{
+    string state; // HALTED, LIMIT, ERROR or LINK ERROR
+    string error;
+    int reg[10];
+    long long executed;
+    double seconds;
+    map<int, string> output; // device -> bytes written by WD
+};
+
+struct WorkQueue
+{
+    mutex lock;
+    deque<int> jobs;
+};
+
+vector<Job> JOBS;
+vector<Result> RESULTS;
+vector<WorkQueue> *QUEUES;
+atomic<int> STOLEN(0);
+
+string removeSpaces(string s)
+{
+    s.erase(remove(s.begin(), s.end(), ' '), s.end());
+    return s;
+}
+
+string formatNumber(int num, int width, char pad = '0')
+{
+    stringstream temp;
+    temp << std::hex << std::uppercase << std::setfill(pad) << std::setw(width) << num;
+    return temp.str();
+}
+
+string formatString(string name, int width, char pad = ' ')
+{
+    stringstream temp;
+    temp << std::left << std::setfill(pad) << std::setw(width) << name;
+    return temp.str();
+}
+
+vector<pair<string, int>> getSymbols(string record)
+{
+    vector<pair<string, int>> symbols;
+    int n = record.length();
+    for (int i = 1; i < n; i += 12)
+    {
+        string symbol = record.substr(i, 6);
+        int value = stoi(record.substr(i + 6, 6), nullptr, 16);
+        symbols.push_back(make_pair(symbol, value));
+    }
+    return symbols;
+}
+
+// manifest line: name PROGADDR limit object[,object...] [XX=file ...]
+// lines starting with "." are comments
+void read_manifest(string input)
+{
+    ifstream fp(input);
+    if (!fp.is_open())
+    {
+        perror(input.c_str());
+        exit(1);
+    }
+
+    string line;
+    int lineNo = 0;
+    while (getline(fp, line))
+    {
+        lineNo++;
+        istringstream iss(line);
+        Job job;
+        string progaddr, limit, objects, device;
+        if (!(iss >> job.name) || job.name[0] == '.')
+            continue;
+        if (!(iss >> progaddr >> limit >> objects))
+        {
+            cerr << input << ":" << lineNo << ": expected name PROGADDR limit objects" << endl;
+            exit(1);
+        }
+        job.progaddr = stoi(progaddr, nullptr, 16);
+        job.limit = stoll(limit);
+
+        stringstream list(objects);
+        string object;
+        while (getline(list, object, ','))
+            if (!object.empty())
+                job.objects.push_back(object);
+
+        while (iss >> device)
+        {
+            size_t eq = device.find('=');
+            if (eq == string::npos || eq == 0)
+            {
+                cerr << input << ":" << lineNo << ": bad device " << device << endl;
+                exit(1);
+            }
+            job.devices[stoi(device.substr(0, eq), nullptr, 16) & 0xFF] = device.substr(eq + 1);
+        }
+        JOBS.push_back(job);
+    }
+    fp.close();
+}
+
+// add delta to the length half-bytes at address; an odd length keeps the high half of the first byte
+void modify(Machine &m, int address, int length, int delta)
+{
+    address &= MEMSIZE - 1;
+    int bytes = (length + 1) / 2;
+
+    int value = 0;
+    for (int i = 0; i < bytes; i++)
+        value = (value << 8) | m.mem[address + i];
+    int halfByte = m.mem[address] & 0xF0;
+
+    value += delta;
+    for (int i = bytes - 1; i >= 0; i--, value >>= 8)
+        m.mem[address + i] = value & 0xFF;
+
+    if (length % 2)
+        m.mem[address] = halfByte | (m.mem[address] & 0x0F);
+}
+
+// link the object programs of a job into the machine memory, like the two passes of linker_loader.cpp
+bool link_job(const Job &job, Machine &m, int &execaddr, string &error)
+{
+    vector<string> records;
+    for (const string &object : job.objects)
+    {
+        ifstream fp(object);
+        if (!fp.is_open())
+        {
+            error = object + ": " + strerror(errno);
+            return false;
+        }
+        string record;
+        while (getline(fp, record))
+            if (!record.empty())
+                records.push_back(record);
+    }
+
+    try
+    {
+        // pass 1: external symbol table
+        map<string, int> ExSymTab;
+        int CSADDR = job.progaddr;
+        int CSLTH = 0;
+        for (string &record : records)
+        {
+            if (record.front() == 'H')
+            {
+                CSADDR = CSADDR + CSLTH;
+                string CSECT = record.substr(1, 6);
+                CSLTH = stoi(record.substr(13, 6), nullptr, 16);
+                if (!ExSymTab.insert({CSECT, CSADDR}).second)
+                {
+                    error = "duplicate external symbol " + removeSpaces(CSECT);
+                    return false;
+                }
+            }
+            else if (record.front() == 'D')
+            {
+                for (pair<string, int> symbol : getSymbols(record))
+                    if (!ExSymTab.insert({symbol.first, symbol.second + CSADDR}).second)
+                    {
+                        error = "duplicate external symbol " + removeSpaces(symbol.first);
+                        return false;
+                    }
+            }
+        }
+        if (CSADDR + CSLTH > MEMSIZE)
+        {
+            error = "program does not fit in memory";
+            return false;
+        }
+
+        // pass 2: text and modification records
+        CSADDR = job.progaddr;
+        execaddr = job.progaddr;
+        CSLTH = 0;
+        for (string &record : records)
+        {
+            if (record.front() == 'H')
+                CSLTH = stoi(record.substr(13, 6), nullptr, 16);
+
+            else if (record.front() == 'T')
+            {
+                int STADDR = stoi(record.substr(1, 6), nullptr, 16) + CSADDR;
+                int INDEX = 0;
+                for (int i = 9; i + 1 < (int)record.length(); i += 2)
+                    m.mem[(STADDR + INDEX++) & (MEMSIZE - 1)] = stoi(record.substr(i, 2), nullptr, 16);
+            }
+
+            else if (record.front() == 'M')
+            {
+                string symbol = record.substr(10, 6);
+                auto it = ExSymTab.find(symbol);
+                if (it == ExSymTab.end())
+                {
+                    error = "undefined symbol " + removeSpaces(symbol);
+                    return false;
+                }
+
+                // grouped records list more addresses after the symbol
+                int length = stoi(record.substr(7, 2), nullptr, 16);
+                modify(m, stoi(record.substr(1, 6), nullptr, 16) + CSADDR, length, record[9] == '+' ? it->second : -it->second);
+                for (int i = 16; i + 6 <= (int)record.length(); i += 6)
+                    modify(m, stoi(record.substr(i, 6), nullptr, 16) + CSADDR, length, record[9] == '+' ? it->second : -it->second);
+            }
+
+            else if (record.front() == 'B')
+            {
+                // relocation bit mask, one bit per byte of the T record
+                int STADDR = stoi(record.substr(1, 6), nullptr, 16) + CSADDR;
+                for (int i = 7; i < (int)record.length(); i++)
+                {
+                    int digit = stoi(record.substr(i, 1), nullptr, 16);
+                    for (int bit = 0; bit < 4; bit++)
+                        if (digit & (8 >> bit))
+                            modify(m, STADDR + (i - 7) * 4 + bit, 5, CSADDR);
+                }
+            }
+
+            else if (record.front() == 'E')
+            {
+                if (record != "E")
+                    execaddr = CSADDR + stoi(record.substr(1, 6), nullptr, 16);
+                CSADDR = CSLTH + CSADDR;
+            }
+        }
+    }
+    catch (exception &e)
+    {
+        error = "bad object record";
+        return false;
+    }
+    return true;
+}
+
+void run_job(int index, Machine &m)
+{
+    const Job &job = JOBS[index];
+    Result &result = RESULTS[index];
+
+    m.reset();
+    for (auto &device : job.devices)
+        m.deviceFiles[device.first] = device.second;
+
+    int execaddr;
+    auto begin = chrono::steady_clock::now();
+    if (!link_job(job, m, execaddr, result.error))
+        result.state = "LINK ERROR";
+    else
+    {
+        int state = m.run(execaddr, job.limit);
+        result.state = state == RUN_HALTED ? "HALTED" : state == RUN_LIMIT ? "LIMIT" : "ERROR";
+        result.error = m.error;
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    memcpy(result.reg, m.reg, sizeof(result.reg));
+    result.executed = m.executed;
+    for (int i = 0; i < 256; i++)
+        if (!m.output[i].empty())
+            result.output[i] = m.output[i];
+}
+
+// next job for worker self: its own queue first, then steal from the others
+bool next_job(int self, int &job)
+{
+    vector<WorkQueue> &queues = *QUEUES;
+    {
+        lock_guard<mutex> guard(queues[self].lock);
+        if (!queues[self].jobs.empty())
+        {
+            job = queues[self].jobs.back();
+            queues[self].jobs.pop_back();
+            return true;
+        }
+    }
+    for (int k = 1; k < (int)queues.size(); k++)
+    {
+        WorkQueue &victim = queues[(self + k) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            STOLEN++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void worker(int self, const Machine *prototype)
+{
+    Machine *m = new Machine();
+    memcpy(m->optable, prototype->optable, sizeof(m->optable));
+    m->captureOutput = true;
+
+    int job;
+    while (next_job(self, job))
+        run_job(job, *m);
+    delete m;
+}
+
+// printable bytes as they are, everything else as \xNN
+string escape(const string &bytes)
+{
+    string out;
+    for (unsigned char c : bytes)
+    {
+        if (c == '\\')
+            out += "\\\\";
+        else if (c >= 32 && c < 127)
+            out += c;
+        else
+            out += "\\x" + formatNumber(c, 2);
+    }
+    return out;
+}
+
+void write_results(string output)
+{
+    ofstream fp(output);
+    if (!fp.is_open())
+    {
+        perror(output.c_str());
+        exit(1);
+    }
+
+    for (int i = 0; i < (int)JOBS.size(); i++)
+    {
+        Result &result = RESULTS[i];
+        fp << formatString(JOBS[i].name, 16) << formatString(result.state, 12) << formatString(to_string(result.executed), 12);
+        fp << "A=" << formatNumber(result.reg[REG_A] & WORD_MASK, 6) << " X=" << formatNumber(result.reg[REG_X] & WORD_MASK, 6)
+           << " L=" << formatNumber(result.reg[REG_L] & WORD_MASK, 6) << " B=" << formatNumber(result.reg[REG_B] & WORD_MASK, 6)
+           << " S=" << formatNumber(result.reg[REG_S] & WORD_MASK, 6) << " T=" << formatNumber(result.reg[REG_T] & WORD_MASK, 6)
+           << " PC=" << formatNumber(result.reg[REG_PC] & WORD_MASK, 6) << " SW=" << formatNumber(result.reg[REG_SW] & WORD_MASK, 6);
+        if (!result.error.empty())
+            fp << " ; " << result.error;
+        fp << "\n";
+        for (auto &out : result.output)
+            fp << formatString("", 16) << "dev" << formatNumber(out.first, 2) << " " << escape(out.second) << "\n";
+    }
+    fp.close();
+}
+
+int main(int argc, char *argv[])
+{
+    // -j sets the number of worker threads, -o the results file
+    int threads = max(1, (int)thread::hardware_concurrency());
+    string output = "results.dat";
+    string manifest;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc && stoi(argv[i + 1]) > 0)
+            threads = stoi(argv[++i]);
+        else if (arg == "-o" && i + 1 < argc)
+            output = argv[++i];
+        else if (manifest.empty() && arg[0] != '-')
+            manifest = arg;
+        else
+        {
+            cerr << "usage: " << argv[0] << " [-j threads] [-o results] manifest" << endl;
+            exit(1);
+        }
+    }
+    if (manifest.empty())
+    {
+        cerr << "usage: " << argv[0] << " [-j threads] [-o results] manifest" << endl;
+        exit(1);
+    }
+
+    read_manifest(manifest);
+    RESULTS.resize(JOBS.size());
+    threads = max(1, min(threads, (int)JOBS.size()));
+
+    Machine *prototype = new Machine();
+    if (!prototype->loadOpTab("opTab.dat"))
+    {
+        perror("opTab.dat");
+        exit(1);
+    }
+
+    // deal the jobs in contiguous runs, one queue per worker
+    vector<WorkQueue> queues(threads);
+    QUEUES = &queues;
+    for (int i = 0; i < (int)JOBS.size(); i++)
+        queues[(long long)i * threads / JOBS.size()].jobs.push_back(i);
+
+    auto begin = chrono::steady_clock::now();
+    vector<thread> pool;
+    for (int i = 0; i < threads; i++)
+        pool.push_back(thread(worker, i, prototype));
+    for (thread &t : pool)
+        t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    delete prototype;
+
+    write_results(output);
+
+    map<string, int> states;
+    long long executed = 0;
+    for (Result &result : RESULTS)
+    {
+        states[result.state]++;
+        executed += result.executed;
+    }
+    cout << JOBS.size() << " programs on " << threads << " threads in " << seconds << " s (" << STOLEN << " stolen)" << endl;
+    for (auto &state : states)
+        cout << formatString(state.first, 12) << state.second << endl;
+    cout << executed << " instructions" << endl;
+    return 0;
+}
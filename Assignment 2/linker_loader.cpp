@@ -7,15 +7,29 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include "sicxe_machine.h"
 
 using namespace std;
 
 int PROGADDR;
 int LAST;
-vector<string> memory((1 << 18), "..");
+int EXECADDR;
+vector<string> memory(MEMSIZE, "..");
 
 map<string, int> ExSymTab;
 
+// control sections in load order, from the H records
+struct ControlSection
+{
+    string name;
+    int address;
+    int length;
+};
+vector<ControlSection> CSECTS;
+
 bool isNumber(string s)
 {
     auto it = s.begin();
@@ -97,7 +111,10 @@ void linker_pass1(string input)
 
             // Enter the CSECT to ExSymTab
             if (ExSymTab.find(CSECT) == ExSymTab.end())
+            {
                 ExSymTab.insert({CSECT, CSADDR});
+                CSECTS.push_back({CSECT, CSADDR, CSLTH});
+            }
             else
             {
                 perror("Duplicate external symbol");
@@ -121,6 +138,71 @@ void linker_pass1(string input)
         }
     }
     LAST = CSADDR + CSLTH;
+    if (LAST > (int)memory.size())
+    {
+        cerr << "program ends at " << formatNumber(LAST, 6) << ", past the end of memory" << endl;
+        exit(1);
+    }
+}
+
+// value of a single hex digit, -1 if not a hex digit
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// add or subtract the address of symbol to the length half-bytes at address
+void apply_modification(int address, int length, char sign, string symbol)
+{
+    if (address < 0 || address + (length + 1) / 2 > (int)memory.size())
+    {
+        cerr << "modification at " << formatNumber(address, 6) << " is outside memory" << endl;
+        exit(1);
+    }
+
+    char halfByte;
+    if (length % 2)
+        halfByte = memory[address][0];
+
+    string val = "";
+    for (int i = 0; i < (length + 1) / 2; i++)
+        val += memory[address + i];
+    int value = stoi(val, nullptr, 16);
+
+    cout << "value          = " << val << endl;
+
+    // apply modification
+    int modification = ExSymTab[symbol];
+    if (sign == '+')
+        value += modification;
+    else
+        value -= modification;
+
+    // apply mask
+    int mask = 0;
+    for (int i = 0; i < (length + length % 2) * 4; i++)
+    {
+        mask |= 1;
+        mask = mask << 1;
+    }
+    mask = mask >> 1;
+    value = value & mask;
+
+    // write back the modified value
+    val = formatNumber(value, length + (length % 2));
+    cout << "modification   = " << formatNumber(modification, 6) << endl;
+    cout << "modified value = " << val << endl;
+    for (int i = 0; i < length; i += 2)
+        memory[address + i / 2] = val.substr(i, 2);
+
+    if (length % 2)
+        memory[address][0] = halfByte;
 }
 
 void linker_pass2(string input)
@@ -134,8 +216,9 @@ void linker_pass2(string input)
     }
 
     int CSADDR = PROGADDR;
-    int EXECADDR = PROGADDR;
+    EXECADDR = PROGADDR;
     int CSLTH = 0;
+    string CSECT = "";
 
     string record;
     while (fp.good())
@@ -147,13 +230,21 @@ void linker_pass2(string input)
             break;
 
         if (record.front() == 'H')
+        {
+            CSECT = record.substr(1, 6);
             CSLTH = stoi(record.substr(13, 6), nullptr, 16);
+        }
 
         if (record.front() == 'T')
         {
             // move the record to its appropriate memory location byte by byte
             int STADDR = stoi(record.substr(1, 6), nullptr, 16) + CSADDR;
             int INDEX = 0;
+            if (STADDR + ((int)record.length() - 9) / 2 > (int)memory.size())
+            {
+                cerr << CSECT << ": T record at " << formatNumber(STADDR, 6) << " ends past the end of memory" << endl;
+                exit(1);
+            }
             for (int i = 9; i < (int)record.length(); i += 2)
                 memory[STADDR + INDEX++] = record.substr(i, 2);
         }
@@ -163,48 +254,11 @@ void linker_pass2(string input)
             string symbol = record.substr(10, 6);
             if (ExSymTab.find(symbol) != ExSymTab.end())
             {
-                // extract address to be modified
-                int address = stoi(record.substr(1, 6), nullptr, 16) + CSADDR;
+                // extract length and the addresses to be modified, grouped records list more after the symbol
                 int length = stoi(record.substr(7, 2), nullptr, 16);
-
-                char halfByte;
-                if (length % 2)
-                    halfByte = memory[address][0];
-
-                string val = "";
-                for (int i = 0; i < (length + 1) / 2; i++)
-                    val += memory[address + i];
-                int value = stoi(val, nullptr, 16);
-
-                cout << "value          = " << val << endl;
-
-                // apply modification
-                int modification = ExSymTab[symbol];
-                char sign = record[9];
-                if (sign == '+')
-                    value += modification;
-                else
-                    value -= modification;
-
-                // apply mask
-                int mask = 0;
-                for (int i = 0; i < (length + length % 2) * 4; i++)
-                {
-                    mask |= 1;
-                    mask = mask << 1;
-                }
-                mask = mask >> 1;
-                value = value & mask;
-
-                // write back the modified value
-                val = formatNumber(value, length + (length % 2));
-                cout << "modification   = " << formatNumber(modification, 6) << endl;
-                cout << "modified value = " << val << endl;
-                for (int i = 0; i < length; i += 2)
-                    memory[address + i / 2] = val.substr(i, 2);
-
-                if (length % 2)
-                    memory[address][0] = halfByte;
+                apply_modification(stoi(record.substr(1, 6), nullptr, 16) + CSADDR, length, record[9], symbol);
+                for (int i = 16; i + 6 <= (int)record.length(); i += 6)
+                    apply_modification(stoi(record.substr(i, 6), nullptr, 16) + CSADDR, length, record[9], symbol);
             }
             else
             {
@@ -214,6 +268,16 @@ void linker_pass2(string input)
             }
         }
 
+        else if (record.front() == 'B')
+        {
+            // relocation bit mask: a set bit adds the CSECT address to the 05 field starting at that byte
+            int STADDR = stoi(record.substr(1, 6), nullptr, 16) + CSADDR;
+            for (int i = 7; i < (int)record.length(); i++)
+                for (int bit = 0; bit < 4; bit++)
+                    if (hexDigit(record[i]) & (8 >> bit))
+                        apply_modification(STADDR + (i - 7) * 4 + bit, 5, '+', CSECT);
+        }
+
         if (record.front() == 'E')
         {
             if (record != "E")
@@ -232,7 +296,7 @@ void print_memory_map()
 {
     ofstream fp("memory.dat");
     int i = (PROGADDR / 16) * 16;
-    int n = ((LAST + 16) / 16) * 16;
+    int n = min(((LAST + 16) / 16) * 16, (int)memory.size());
     // cout << i << " " << n << endl;
     while (i < n)
     {
@@ -251,8 +315,337 @@ void print_memory_map()
     fp.close();
 }
 
-int main()
+// byte value of a memory cell, unloaded cells ("..") read as 0
+unsigned char cellValue(const string &cell)
+{
+    int hi = hexDigit(cell[0]), lo = hexDigit(cell[1]);
+    return (unsigned char)(((hi < 0 ? 0 : hi) << 4) | (lo < 0 ? 0 : lo));
+}
+
+// raw bytes of the loaded program from PROGADDR to LAST
+vector<unsigned char> memory_bytes()
+{
+    vector<unsigned char> bytes(max(LAST - PROGADDR, 0));
+    for (int i = 0; i < (int)bytes.size(); i++)
+        bytes[i] = cellValue(memory[PROGADDR + i]);
+    return bytes;
+}
+
+// write the loaded program as header + raw bytes in a single write, so it can be mmap-ed directly
+void write_memory_image()
+{
+    vector<unsigned char> bytes = memory_bytes();
+
+    ImageHeader header = {{'S', 'X', 'E', '1'}, (uint32_t)PROGADDR, (uint32_t)bytes.size(), (uint32_t)EXECADDR};
+    vector<char> image(IMAGE_HEADER_SIZE + bytes.size());
+    writeImageHeader((uint8_t *)image.data(), header);
+    if (!bytes.empty())
+        memcpy(image.data() + IMAGE_HEADER_SIZE, bytes.data(), bytes.size());
+
+    ofstream fp("memory.bin", ios::binary);
+    if (!fp.is_open())
+    {
+        perror("memory.bin");
+        exit(1);
+    }
+    fp.write(image.data(), image.size());
+    fp.close();
+}
+
+// hex dump of the loaded program, 16 bytes per line; lines with nothing loaded are collapsed into a single "*"
+void print_memory_hex()
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    // each line: 6 address digits, 16 bytes in 4 groups, newline
+    const int LINE = 6 + 16 * 2 + 4 + 1;
+    int i = (PROGADDR / 16) * 16;
+    int n = ((LAST + 15) / 16) * 16;
+
+    string out;
+    out.reserve((size_t)(n - i) / 16 * LINE + 2);
+    bool skipping = false;
+    for (; i < n; i += 16)
+    {
+        bool loaded = false;
+        for (int k = 0; k < 16 && !loaded; k++)
+            loaded = memory[i + k] != "..";
+
+        if (!loaded)
+        {
+            if (!skipping)
+                out += "*\n";
+            skipping = true;
+            continue;
+        }
+        skipping = false;
+
+        char line[LINE];
+        char *p = line;
+        for (int shift = 20; shift >= 0; shift -= 4)
+            *p++ = digits[(i >> shift) & 0xF];
+        for (int k = 0; k < 16; k++)
+        {
+            if (k % 4 == 0)
+                *p++ = ' ';
+            *p++ = memory[i + k][0];
+            *p++ = memory[i + k][1];
+        }
+        *p++ = '\n';
+        out.append(line, p - line);
+    }
+
+    ofstream fp("memoryHex.dat");
+    fp.write(out.data(), out.size());
+    fp.close();
+}
+
+// name of an address: a CSECT or external symbol if one starts there, CSECT+offset otherwise
+string addressName(int address)
+{
+    for (ControlSection &cs : CSECTS)
+        if (cs.address == address)
+            return removeSpaces(cs.name);
+    for (auto &x : ExSymTab)
+        if (x.second == address)
+            return removeSpaces(x.first);
+    for (ControlSection &cs : CSECTS)
+        if (address >= cs.address && address < cs.address + cs.length)
+            return removeSpaces(cs.name) + "+" + formatNumber(address - cs.address, 4);
+    return formatNumber(address, 6);
+}
+
+string percent(uint64_t part, uint64_t total)
+{
+    stringstream temp;
+    temp << fixed << setprecision(2) << (total ? 100.0 * part / total : 0.0) << "%";
+    return temp.str();
+}
+
+// flat profile, per-CSECT totals and call graph
+void print_profile(const Profile &profile)
+{
+    ofstream fp("profile.dat");
+    string unit = profile.period ? "samples" : "instructions";
+
+    uint64_t total = 0;
+    vector<int> hot;
+    for (int i = 0; i < MEMSIZE; i++)
+        if (profile.exec[i])
+        {
+            total += profile.exec[i];
+            hot.push_back(i);
+        }
+    sort(hot.begin(), hot.end(), [&](int a, int b)
+         { return profile.exec[a] != profile.exec[b] ? profile.exec[a] > profile.exec[b] : a < b; });
+
+    fp << "Flat profile: " << total << " " << unit;
+    if (profile.period)
+        fp << " (one sample every " << profile.period << " instructions)";
+    fp << "\n\n";
+
+    // totals per control section
+    fp << formatString("CSECT", 8) << formatString("ADDRESS", 9) << formatString("LENGTH", 8) << formatString(unit, 14) << formatString("%", 9);
+    if (!profile.period)
+        fp << formatString("READS", 12) << "WRITES";
+    fp << "\n";
+    for (ControlSection &cs : CSECTS)
+    {
+        uint64_t count = 0, reads = 0, writes = 0;
+        for (int i = cs.address; i < cs.address + cs.length; i++)
+        {
+            count += profile.exec[i];
+            if (!profile.period)
+            {
+                reads += profile.reads[i];
+                writes += profile.writes[i];
+            }
+        }
+        fp << formatString(cs.name, 8) << formatString(formatNumber(cs.address, 6), 9) << formatString(formatNumber(cs.length, 4), 8)
+           << formatString(to_string(count), 14) << formatString(percent(count, total), 9);
+        if (!profile.period)
+            fp << formatString(to_string(reads), 12) << writes;
+        fp << "\n";
+    }
+
+    // hot addresses
+    fp << "\n" << formatString("ADDRESS", 9) << formatString(unit, 14) << formatString("%", 9) << formatString("CUMUL", 9) << "LOCATION\n";
+    uint64_t cumulative = 0;
+    for (int address : hot)
+    {
+        cumulative += profile.exec[address];
+        fp << formatString(formatNumber(address, 6), 9) << formatString(to_string(profile.exec[address]), 14)
+           << formatString(percent(profile.exec[address], total), 9) << formatString(percent(cumulative, total), 9) << addressName(address) << "\n";
+    }
+
+    // call graph
+    fp << "\nCall graph (JSUB)\n";
+    for (auto &call : profile.calls)
+        fp << formatString(addressName(call.first.first), 14) << " -> " << formatString(addressName(call.first.second), 14) << " " << call.second << "\n";
+    fp << "RSUB executed " << profile.returns << " times\n";
+    fp.close();
+}
+
+// listing.dat with the execution and memory access counts of every line
+void print_profile_listing(const Profile &profile)
 {
+    ifstream fp("listing.dat");
+    if (!fp.is_open())
+    {
+        perror("listing.dat");
+        return;
+    }
+
+    // absolute address of every listing line, -1 for lines without one
+    vector<string> lines;
+    vector<int> address;
+    vector<int> sectionEnd;
+    string line;
+    int CSADDR = PROGADDR, CSEND = PROGADDR;
+    while (getline(fp, line))
+    {
+        istringstream iss(line);
+        vector<string> tokens;
+        string token;
+        while (iss >> token)
+            tokens.push_back(token);
+
+        int addr = -1;
+        bool located = tokens.size() > 1 && tokens[0].length() == 4 && all_of(tokens[0].begin(), tokens[0].end(), ::isxdigit);
+        if (located && tokens.size() > 2 && (tokens[2] == "START" || tokens[2] == "CSECT"))
+        {
+            for (ControlSection &cs : CSECTS)
+                if (removeSpaces(cs.name) == tokens[1])
+                {
+                    CSADDR = cs.address;
+                    CSEND = cs.address + cs.length;
+                }
+        }
+        else if (located && find(tokens.begin(), tokens.end(), "EQU") == tokens.end())
+            addr = CSADDR + stoi(tokens[0], nullptr, 16);
+
+        lines.push_back(line);
+        address.push_back(addr);
+        sectionEnd.push_back(CSEND);
+    }
+    fp.close();
+
+    ofstream out("profileListing.dat");
+    out << formatString(profile.period ? "SAMPLES" : "COUNT", 12);
+    if (!profile.period)
+        out << formatString("READS", 10) << formatString("WRITES", 10);
+    out << "| LINE\n";
+
+    for (int i = 0; i < (int)lines.size(); i++)
+    {
+        if (address[i] < 0)
+        {
+            out << formatString("", profile.period ? 12 : 32) << "| " << lines[i] << "\n";
+            continue;
+        }
+
+        // a line covers the bytes up to the next located line of its CSECT
+        int end = sectionEnd[i];
+        for (int j = i + 1; j < (int)lines.size(); j++)
+            if (address[j] >= 0)
+            {
+                if (address[j] > address[i] && address[j] < end)
+                    end = address[j];
+                break;
+            }
+
+        out << formatString(to_string(profile.exec[address[i]]), 12);
+        if (!profile.period)
+        {
+            uint64_t reads = 0, writes = 0;
+            for (int a = address[i]; a < max(end, address[i] + 1); a++)
+            {
+                reads += profile.reads[a];
+                writes += profile.writes[a];
+            }
+            out << formatString(to_string(reads), 10) << formatString(to_string(writes), 10);
+        }
+        out << "| " << lines[i] << "\n";
+    }
+    out.close();
+}
+
+// run the loaded program on the SIC/XE machine starting at EXECADDR
+void execute_program(long long limit, bool profiling, long long period)
+{
+    Machine machine;
+    if (profiling)
+        machine.profile = new Profile(period);
+    if (!machine.loadOpTab("opTab.dat"))
+    {
+        perror("opTab.dat");
+        exit(1);
+    }
+
+    vector<unsigned char> bytes = memory_bytes();
+    machine.load(PROGADDR, bytes.data(), bytes.size());
+
+    auto begin = chrono::steady_clock::now();
+    int result = machine.run(EXECADDR, limit);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    if (result == RUN_HALTED)
+        cout << "Program halted" << endl;
+    else if (result == RUN_LIMIT)
+        cout << "Instruction limit reached" << endl;
+    else
+        cout << "Execution error: " << machine.error << " at " << formatNumber(machine.reg[REG_PC], 6) << endl;
+
+    cout << "A=" << formatNumber(machine.reg[REG_A], 6) << " X=" << formatNumber(machine.reg[REG_X], 6)
+         << " L=" << formatNumber(machine.reg[REG_L], 6) << " B=" << formatNumber(machine.reg[REG_B], 6)
+         << " S=" << formatNumber(machine.reg[REG_S], 6) << " T=" << formatNumber(machine.reg[REG_T], 6)
+         << " PC=" << formatNumber(machine.reg[REG_PC], 6) << " SW=" << formatNumber(machine.reg[REG_SW], 6) << endl;
+    cout << machine.executed << " instructions in " << seconds << " s";
+    if (seconds > 0)
+        cout << " (" << machine.executed / seconds / 1e6 << " MIPS)";
+    cout << endl;
+
+    if (profiling)
+    {
+        print_profile(*machine.profile);
+        print_profile_listing(*machine.profile);
+        delete machine.profile;
+        machine.profile = NULL;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // optional output formats: -b binary image (memory.bin), -x compact hex dump (memoryHex.dat)
+    // -r runs the program after loading, -n sets its instruction limit
+    // -p profiles the run with exact counts, -s <n> samples the PC every n instructions instead
+    bool binary = false, hexdump = false, run = false, profiling = false;
+    long long limit = 100000000, period = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-b")
+            binary = true;
+        else if (arg == "-x")
+            hexdump = true;
+        else if (arg == "-r")
+            run = true;
+        else if (arg == "-n" && i + 1 < argc)
+            limit = stoll(argv[++i]);
+        else if (arg == "-p")
+            run = profiling = true;
+        else if (arg == "-s" && i + 1 < argc && stoll(argv[i + 1]) > 0)
+        {
+            run = profiling = true;
+            period = stoll(argv[++i]);
+        }
+        else
+        {
+            cerr << "usage: " << argv[0] << " [-b] [-x] [-r] [-n limit] [-p | -s period]" << endl;
+            exit(1);
+        }
+    }
+
     // run the  2-pass link loader assembler
     linker_pass1("output.dat");
     ofstream fp("exSymTab.dat");
@@ -266,5 +659,11 @@ int main()
     // cout << "----------------------" << endl;
 
     print_memory_map();
+    if (binary)
+        write_memory_image();
+    if (hexdump)
+        print_memory_hex();
+    if (run)
+        execute_program(limit, profiling, period);
     return 0;
 }
\ No newline at end of file
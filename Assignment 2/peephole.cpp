@@ -0,0 +1,350 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+// Peephole optimizer run before assembler_pass1. It tokenizes the source like
+// pass 1, splits every CSECT into basic blocks (labels and the instructions
+// after jumps start a block) and applies the rewrites below until none applies.
+// Labelled lines are never removed and jumps to EXTREF symbols are left alone,
+// so every address other code can name stays where it is.
+
+// Global maps for opcode table
+map<string, pair<string, string>> opCodeTable;
+
+// Function to load opcode table from a file
+void loadOpCodeTable()
+{
+    ifstream optabFile("opTab.dat");
+    if (!optabFile)
+    {
+        cerr << "Error opening optab file\n";
+        exit(EXIT_FAILURE);
+    }
+
+    string mnemonic, opcode, format;
+    while (optabFile >> opcode >> format >> mnemonic)
+        opCodeTable[opcode] = {format, mnemonic};
+
+    optabFile.close();
+}
+
+string formatString(string name, int width)
+{
+    stringstream temp;
+    temp << left << setfill(' ') << setw(width) << name;
+    return temp.str();
+}
+
+// one source line
+struct Line
+{
+    string text;
+    string label, opcode, operands; // operands without the #, @ or = prefix
+    char mode;                      // ' ', '#', '@' or '='
+    bool comment;
+    bool removed;
+    string CSECT;
+    int block; // basic block of an instruction, -1 for other lines
+};
+
+vector<Line> LINES;
+
+// tokenize a line the way assembler_pass1 does
+Line parseLine(string text)
+{
+    Line line = {text, "", "", "", ' ', false, false, "", -1};
+    istringstream iss(text);
+    iss >> ws;
+    if (iss.peek() == '.')
+    {
+        line.comment = true;
+        return line;
+    }
+
+    vector<string> words;
+    string word;
+    while (iss >> word)
+        words.push_back(word);
+
+    if (words.size() == 1)
+        line.opcode = words[0];
+    else if (words.size() == 2 && words[1] == "CSECT")
+    {
+        line.label = words[0];
+        line.opcode = "CSECT";
+    }
+    else if (words.size() == 2)
+    {
+        line.opcode = words[0];
+        line.operands = words[1];
+    }
+    else if (words.size() == 3)
+    {
+        line.label = words[0];
+        line.opcode = words[1];
+        line.operands = words[2];
+    }
+    else if (words.size() > 3 && words[1] == "BYTE")
+    {
+        line.label = words[0];
+        line.opcode = words[1];
+        line.operands = text.substr(text.find("BYTE") + 4);
+    }
+    else
+        line.comment = true;
+
+    if (!line.opcode.empty() && line.opcode[0] == '+')
+        line.opcode.erase(0, 1);
+    if (!line.operands.empty() && (line.operands[0] == '#' || line.operands[0] == '@' || line.operands[0] == '='))
+    {
+        line.mode = line.operands[0];
+        line.operands.erase(0, 1);
+    }
+    return line;
+}
+
+bool isInstruction(const Line &line)
+{
+    return !line.comment && opCodeTable.count(line.opcode);
+}
+
+bool isJump(const string &opcode)
+{
+    return opcode == "J" || opcode == "JEQ" || opcode == "JLT" || opcode == "JGT" || opcode == "JSUB" || opcode == "RSUB";
+}
+
+// operand indexed by X, its address changes with the register
+bool isIndexed(const Line &line)
+{
+    return line.operands.find(",X") != string::npos;
+}
+
+// index of the next line that is not removed and not a comment, -1 at the end
+int nextLine(int i)
+{
+    for (int j = i + 1; j < (int)LINES.size(); j++)
+        if (!LINES[j].removed && !LINES[j].comment)
+            return j;
+    return -1;
+}
+
+// CSECTs, basic blocks and the labels of every CSECT
+int findBlocks(map<pair<string, string>, int> &labels)
+{
+    labels.clear();
+    string CSECT = "";
+    int blocks = 0;
+    bool leader = true;
+    for (int i = 0; i < (int)LINES.size(); i++)
+    {
+        Line &line = LINES[i];
+        if (line.removed || line.comment)
+            continue;
+        if (line.opcode == "START" || line.opcode == "CSECT")
+        {
+            CSECT = line.label;
+            leader = true;
+        }
+        line.CSECT = CSECT;
+        if (line.label != "")
+            labels[{CSECT, line.label}] = i;
+
+        line.block = -1;
+        if (!isInstruction(line))
+        {
+            leader = true;
+            continue;
+        }
+        if (leader || line.label != "")
+            blocks++;
+        line.block = blocks - 1;
+        leader = isJump(line.opcode);
+    }
+    return blocks;
+}
+
+// replace the operand of a line, keeping its prefix and the other columns
+void setOperand(Line &line, string operand)
+{
+    string prefix = line.mode == ' ' ? "" : string(1, line.mode);
+    size_t pos = line.text.rfind(prefix + line.operands);
+    line.text.replace(pos, prefix.length() + line.operands.length(), prefix + operand);
+    line.operands = operand;
+}
+
+int main(int argc, char *argv[])
+{
+    string input = argc > 1 ? argv[1] : "input.dat";
+    string output = argc > 2 ? argv[2] : "optimized.dat";
+
+    ifstream fp(input);
+    if (!fp.is_open())
+    {
+        perror(input.c_str());
+        exit(1);
+    }
+    loadOpCodeTable();
+
+    string text;
+    while (getline(fp, text))
+    {
+        // end of file stop reading
+        if (text.empty())
+            break;
+        LINES.push_back(parseLine(text));
+    }
+    fp.close();
+
+    ofstream report("peepholeReport.dat");
+    map<string, int> applied;
+    int instructionsBefore = 0, bytesBefore = 0;
+    for (Line &line : LINES)
+        if (isInstruction(line))
+        {
+            instructionsBefore++;
+            bytesBefore += stoi(opCodeTable[line.opcode].first);
+        }
+
+    // CSECTs where computed addresses like LABEL+3, indexed jumps into a jump
+    // table (J JTAB,X) or indirect jumps may reach unlabelled code
+    set<string> computed;
+
+    map<pair<string, string>, int> labels;
+    int blocks = findBlocks(labels);
+    report << blocks << " basic blocks before optimization" << endl;
+    for (Line &line : LINES)
+        if (!line.comment && line.operands.find_first_of("+-*/") != string::npos && line.opcode != "BYTE")
+            computed.insert(line.CSECT);
+        else if (isInstruction(line) && isJump(line.opcode) && (isIndexed(line) || line.mode == '@'))
+            computed.insert(line.CSECT);
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        findBlocks(labels);
+
+        for (int i = 0; i < (int)LINES.size(); i++)
+        {
+            Line &line = LINES[i];
+            if (line.removed || !isInstruction(line))
+                continue;
+            int n = nextLine(i);
+            Line *next = n >= 0 ? &LINES[n] : NULL;
+
+            // STx X followed by LDx X in the same block: the register already holds the value
+            static const map<string, string> storeLoad = {{"STA", "LDA"}, {"STX", "LDX"}, {"STL", "LDL"}, {"STB", "LDB"}, {"STS", "LDS"}, {"STT", "LDT"}};
+            auto store = storeLoad.find(line.opcode);
+            if (store != storeLoad.end() && next && next->block == line.block && next->opcode == store->second &&
+                line.mode == ' ' && next->mode == ' ' && next->operands == line.operands && !isIndexed(line) && !isIndexed(*next))
+            {
+                report << "store-load    line " << n + 1 << ": removed " << next->opcode << " " << next->operands << " after " << line.opcode << endl;
+                next->removed = true;
+                applied["store-load"]++;
+                changed = true;
+                continue;
+            }
+
+            // the same store twice in a row
+            if (store != storeLoad.end() && next && next->block == line.block && next->opcode == line.opcode &&
+                line.mode == ' ' && next->mode == ' ' && next->operands == line.operands && !isIndexed(line) && !isIndexed(*next))
+            {
+                report << "store-store   line " << n + 1 << ": removed " << next->opcode << " " << next->operands << endl;
+                next->removed = true;
+                applied["store-store"]++;
+                changed = true;
+                continue;
+            }
+
+            // LDx X followed by STx X in the same block: memory already holds the value
+            static const map<string, string> loadStore = {{"LDA", "STA"}, {"LDX", "STX"}, {"LDL", "STL"}, {"LDB", "STB"}, {"LDS", "STS"}, {"LDT", "STT"}};
+            auto load = loadStore.find(line.opcode);
+            if (load != loadStore.end() && next && next->block == line.block && next->opcode == load->second &&
+                line.mode == ' ' && next->mode == ' ' && next->operands == line.operands && !isIndexed(line) && !isIndexed(*next))
+            {
+                report << "load-store    line " << n + 1 << ": removed " << next->opcode << " " << next->operands << " after " << line.opcode << endl;
+                next->removed = true;
+                applied["load-store"]++;
+                changed = true;
+                continue;
+            }
+
+            if (!isJump(line.opcode) || line.opcode == "RSUB" || line.mode != ' ')
+                continue;
+            auto target = labels.find({line.CSECT, line.operands});
+            if (target == labels.end())
+                continue; // EXTREF or computed target
+
+            // jump to the next instruction, unless it may be an entry of a jump table
+            if (line.opcode != "JSUB" && line.label == "" && next && isInstruction(*next) && target->second == n && !computed.count(line.CSECT))
+            {
+                report << "jump-next     line " << i + 1 << ": removed " << line.opcode << " " << line.operands << endl;
+                line.removed = true;
+                applied["jump-next"]++;
+                changed = true;
+                continue;
+            }
+
+            // jump to an unconditional jump: go to its target directly, unless that target is
+            // this line (A J B / B J A would become A J A, which the machine treats as a halt)
+            Line &hop = LINES[target->second];
+            auto hopTarget = labels.find({line.CSECT, hop.operands});
+            if (isInstruction(hop) && hop.opcode == "J" && hop.mode == ' ' && hop.operands != line.operands &&
+                hopTarget != labels.end() && hopTarget->second != i)
+            {
+                report << "jump-thread   line " << i + 1 << ": " << line.opcode << " " << line.operands << " -> " << line.opcode << " " << hop.operands << endl;
+                setOperand(line, hop.operands);
+                applied["jump-thread"]++;
+                changed = true;
+                continue;
+            }
+        }
+
+        // unlabelled instructions after J or RSUB can't be reached
+        for (int i = 0; i < (int)LINES.size(); i++)
+        {
+            Line &line = LINES[i];
+            if (line.removed || !isInstruction(line) || (line.opcode != "J" && line.opcode != "RSUB") || computed.count(line.CSECT))
+                continue;
+            for (int n = nextLine(i); n >= 0 && isInstruction(LINES[n]) && LINES[n].label == ""; n = nextLine(n))
+            {
+                report << "dead-code     line " << n + 1 << ": removed " << LINES[n].opcode << " " << LINES[n].operands << endl;
+                LINES[n].removed = true;
+                applied["dead-code"]++;
+                changed = true;
+            }
+        }
+    }
+
+    ofstream out(output);
+    int instructionsAfter = 0, bytesAfter = 0;
+    for (Line &line : LINES)
+    {
+        if (line.removed)
+            continue;
+        out << line.text << "\n";
+        if (isInstruction(line))
+        {
+            instructionsAfter++;
+            bytesAfter += stoi(opCodeTable[line.opcode].first);
+        }
+    }
+    out.close();
+
+    report << findBlocks(labels) << " basic blocks after optimization" << endl;
+    for (auto &rule : applied)
+        report << formatString(rule.first, 14) << rule.second << endl;
+    report << "instructions " << instructionsBefore << " -> " << instructionsAfter << ", bytes " << bytesBefore << " -> " << bytesAfter << endl;
+    report.close();
+
+    cout << "peephole: " << instructionsBefore - instructionsAfter << " instructions removed, written to " << output << endl;
+    return 0;
+}
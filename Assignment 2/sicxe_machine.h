@@ -0,0 +1,739 @@
+#ifndef SICXE_MACHINE_H
+#define SICXE_MACHINE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sicxe_memory.h"
+
+using namespace std;
+
+// SIC/XE machine: register file, 1 MB memory and a threaded-code interpreter.
+// Instructions are decoded once into a cache indexed by address; a write that
+// touches a decoded instruction drops its cache entry so self-modifying code
+// is re-decoded on the next fetch. Dispatch uses computed goto (g++/clang).
+
+// register numbers as used in format 2 instructions
+enum
+{
+    REG_A = 0,
+    REG_X = 1,
+    REG_L = 2,
+    REG_B = 3,
+    REG_S = 4,
+    REG_T = 5,
+    REG_F = 6,
+    REG_PC = 8,
+    REG_SW = 9
+};
+
+// condition code, kept in the low two bits of SW
+enum
+{
+    CC_EQ = 0,
+    CC_LT = 1,
+    CC_GT = 2
+};
+
+// result of Machine::run
+enum
+{
+    RUN_HALTED, // returned to HALT_ADDR or hit a "J *" loop
+    RUN_LIMIT,  // instruction limit reached
+    RUN_ERROR   // illegal instruction, invalid register, bad address, division by zero
+};
+
+const int WORD_MASK = 0xFFFFFF;
+const int HALT_ADDR = 0xFFFFFF; // initial L, returning to it stops the machine
+
+// Header of the binary memory image (memory.bin), followed by length raw bytes
+struct ImageHeader
+{
+    char magic[4];     // "SXE1"
+    uint32_t progaddr; // load address of the first byte
+    uint32_t length;   // number of bytes that follow the header
+    uint32_t execaddr; // address to start execution at
+};
+
+const int IMAGE_HEADER_SIZE = 16; // magic and three little-endian 32-bit words
+
+// store the header byte by byte in little-endian order, whatever the host byte order
+inline void writeImageHeader(uint8_t *out, const ImageHeader &header)
+{
+    const uint32_t fields[3] = {header.progaddr, header.length, header.execaddr};
+    memcpy(out, header.magic, 4);
+    for (int i = 0; i < 3; i++)
+        for (int k = 0; k < 4; k++)
+            out[4 + 4 * i + k] = (fields[i] >> (8 * k)) & 0xFF;
+}
+
+inline void readImageHeader(const uint8_t *in, ImageHeader &header)
+{
+    uint32_t fields[3];
+    memcpy(header.magic, in, 4);
+    for (int i = 0; i < 3; i++)
+    {
+        fields[i] = 0;
+        for (int k = 0; k < 4; k++)
+            fields[i] |= (uint32_t)in[4 + 4 * i + k] << (8 * k);
+    }
+    header.progaddr = fields[0];
+    header.length = fields[1];
+    header.execaddr = fields[2];
+}
+
+// codemark bits
+enum
+{
+    CODE_DECODED = 1,   // byte of an instruction in the decode cache
+    CODE_TRANSLATED = 2 // byte of an instruction inside translated native code
+};
+
+// addressing modes from the n/i flags
+enum
+{
+    MODE_SIMPLE,
+    MODE_IMMEDIATE,
+    MODE_INDIRECT
+};
+
+// extra address terms added at execution time
+enum
+{
+    ADDR_X = 1,
+    ADDR_BASE = 2
+};
+
+// operations known to the machine, the opcode bytes come from opTab.dat
+enum
+{
+    OP_DECODE, // cache entry not decoded yet
+    OP_LDA, OP_LDX, OP_LDL, OP_LDB, OP_LDS, OP_LDT, OP_LDCH, OP_LDF,
+    OP_STA, OP_STX, OP_STL, OP_STB, OP_STS, OP_STT, OP_STCH, OP_STF, OP_STSW,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_COMP, OP_AND, OP_OR,
+    OP_J, OP_JEQ, OP_JLT, OP_JGT, OP_JSUB, OP_RSUB, OP_TIX,
+    OP_TD, OP_RD, OP_WD,
+    OP_ADDR, OP_SUBR, OP_MULR, OP_DIVR, OP_COMPR, OP_CLEAR, OP_RMO, OP_TIXR, OP_SHIFTL, OP_SHIFTR,
+    OP_BADREG, // format 2 instruction naming a register that can't be used, stops with an error
+    OP_COUNT
+};
+
+static const pair<const char *, int> MNEMONICS[] = {
+    {"LDA", OP_LDA}, {"LDX", OP_LDX}, {"LDL", OP_LDL}, {"LDB", OP_LDB}, {"LDS", OP_LDS}, {"LDT", OP_LDT}, {"LDCH", OP_LDCH}, {"LDF", OP_LDF},
+    {"STA", OP_STA}, {"STX", OP_STX}, {"STL", OP_STL}, {"STB", OP_STB}, {"STS", OP_STS}, {"STT", OP_STT}, {"STCH", OP_STCH}, {"STF", OP_STF}, {"STSW", OP_STSW},
+    {"ADD", OP_ADD}, {"SUB", OP_SUB}, {"MUL", OP_MUL}, {"DIV", OP_DIV}, {"COMP", OP_COMP}, {"AND", OP_AND}, {"OR", OP_OR},
+    {"J", OP_J}, {"JEQ", OP_JEQ}, {"JLT", OP_JLT}, {"JGT", OP_JGT}, {"JSUB", OP_JSUB}, {"RSUB", OP_RSUB}, {"TIX", OP_TIX},
+    {"TD", OP_TD}, {"RD", OP_RD}, {"WD", OP_WD},
+    {"ADDR", OP_ADDR}, {"SUBR", OP_SUBR}, {"MULR", OP_MULR}, {"DIVR", OP_DIVR}, {"COMPR", OP_COMPR}, {"CLEAR", OP_CLEAR}, {"RMO", OP_RMO}, {"TIXR", OP_TIXR}, {"SHIFTL", OP_SHIFTL}, {"SHIFTR", OP_SHIFTR},
+};
+
+// one predecoded instruction
+struct Decoded
+{
+    uint8_t op;     // OP_* id, OP_DECODE if the entry is empty
+    uint8_t length; // 1 to 4 bytes
+    uint8_t mode;   // MODE_*
+    uint8_t flags;  // ADDR_*
+    uint8_t r1, r2; // format 2 operands
+    int addr;       // target address without X and B, PC-relative already applied
+};
+
+// opcode byte -> operation and format
+struct OpInfo
+{
+    uint8_t id;
+    uint8_t format;
+};
+
+// sign extend a 24-bit word
+// format 2 register number that indexes reg[]: A, X, L, B, S, T, PC and SW. F (6) is
+// 48 bits wide and kept apart, 7 and 10-15 are not registers
+inline bool validRegister(int r)
+{
+    return r <= REG_T || r == REG_PC || r == REG_SW;
+}
+
+inline int signWord(int v)
+{
+    return (int)((uint32_t)v << 8) >> 8;
+}
+
+// execution profile collected by Machine::run while Machine::profile is set
+struct Profile
+{
+    long long period;                    // 0 counts every instruction and memory access, n samples the PC every n instructions
+    long long countdown;                 // instructions left until the next sample
+    vector<uint64_t> exec;               // instructions executed (or samples taken) per address
+    vector<uint64_t> reads, writes;      // memory accesses per address, counting mode only
+    map<pair<int, int>, uint64_t> calls; // (caller entry, callee entry) -> JSUB count
+    vector<int> stack;                   // entries of the active subroutines
+    uint64_t returns;                    // RSUB count
+
+    Profile(long long period = 0) : period(period), countdown(period), exec(MEMSIZE, 0), returns(0)
+    {
+        if (!period)
+        {
+            reads.assign(MEMSIZE, 0);
+            writes.assign(MEMSIZE, 0);
+        }
+    }
+};
+
+class Machine
+{
+public:
+    vector<uint8_t> mem;      // MEMSIZE bytes plus padding for reads at the top
+    int reg[10];              // A, X, L, B, S, T, -, -, PC, SW
+    uint64_t F;               // 48-bit floating point register, kept as raw bits
+    long long executed;       // instructions executed so far
+    string error;             // reason for RUN_ERROR
+    OpInfo optable[256];      // filled by loadOpTab
+    vector<Decoded> cache;    // predecoded instructions indexed by address
+    vector<uint8_t> codemark; // CODE_* bits for bytes that belong to decoded or translated code
+    vector<int> codeWrites;   // addresses written inside translated code, consumed by the runner
+    FILE *devices[256];       // devices opened by RD/WD
+    string deviceDir;         // directory of the devXX.dat files
+    string deviceFiles[256];  // file of a device, overrides deviceDir/devXX.dat when set
+    bool captureOutput;       // keep WD bytes in output[] instead of writing devXX.dat
+    string output[256];       // bytes written to every device while captureOutput is set
+    Profile *profile;         // collect a profile while running, NULL to run at full speed
+
+    Machine() : mem(MEMSIZE + 8, 0), F(0), executed(0), cache(MEMSIZE + 8), codemark(MEMSIZE + 8, 0), captureOutput(false), profile(NULL)
+    {
+        memset(reg, 0, sizeof(reg));
+        memset(optable, 0, sizeof(optable));
+        memset(&cache[0], 0, cache.size() * sizeof(Decoded));
+        for (int i = 0; i < 256; i++)
+            devices[i] = NULL;
+        reg[REG_L] = HALT_ADDR;
+    }
+
+    ~Machine()
+    {
+        for (int i = 0; i < 256; i++)
+            if (devices[i])
+                fclose(devices[i]);
+    }
+
+    // back to the power-on state for the next program, the opcode table is kept
+    void reset()
+    {
+        memset(mem.data(), 0, mem.size());
+        for (int i = 0; i < (int)codemark.size(); i++)
+            if (codemark[i])
+            {
+                cache[i].op = OP_DECODE;
+                codemark[i] = 0;
+            }
+        memset(reg, 0, sizeof(reg));
+        reg[REG_L] = HALT_ADDR;
+        F = 0;
+        executed = 0;
+        error.clear();
+        codeWrites.clear();
+        for (int i = 0; i < 256; i++)
+        {
+            if (devices[i])
+                fclose(devices[i]);
+            devices[i] = NULL;
+            deviceFiles[i].clear();
+            output[i].clear();
+        }
+    }
+
+    // read opTab.dat and map its opcode bytes onto the operations above
+    bool loadOpTab(const string &file)
+    {
+        ifstream optabFile(file);
+        if (!optabFile)
+            return false;
+
+        map<string, int> ids;
+        for (auto &m : MNEMONICS)
+            ids[m.first] = m.second;
+
+        string mnemonic, format, opcode;
+        while (optabFile >> mnemonic >> format >> opcode)
+        {
+            auto it = ids.find(mnemonic);
+            if (it == ids.end())
+            {
+                cerr << "machine: no semantics for " << mnemonic << ", ignored" << endl;
+                continue;
+            }
+            int byte = stoi(opcode, nullptr, 16) & 0xFC;
+            optable[byte].id = it->second;
+            optable[byte].format = stoi(format);
+        }
+        optabFile.close();
+        return true;
+    }
+
+    // copy a loaded image into memory
+    void load(int addr, const uint8_t *bytes, int n)
+    {
+        for (int i = 0; i < n; i++)
+            writeByte(addr + i, bytes[i]);
+    }
+
+    // map memory.bin written by "linkloader -b" and copy it into memory
+    bool loadImage(const string &file, ImageHeader &header)
+    {
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < (off_t)IMAGE_HEADER_SIZE)
+        {
+            close(fd);
+            return false;
+        }
+
+        void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (image == MAP_FAILED)
+            return false;
+
+        readImageHeader((const uint8_t *)image, header);
+        bool ok = memcmp(header.magic, "SXE1", 4) == 0 && IMAGE_HEADER_SIZE + (size_t)header.length <= (size_t)st.st_size &&
+                  header.progaddr <= (uint32_t)MEMSIZE && header.length <= (uint32_t)MEMSIZE - header.progaddr;
+        if (ok)
+            load(header.progaddr, (const uint8_t *)image + IMAGE_HEADER_SIZE, header.length);
+
+        munmap(image, st.st_size);
+        return ok;
+    }
+
+    int readByte(int addr) const { return mem[addr & (MEMSIZE - 1)]; }
+
+    int readWord(int addr) const
+    {
+        addr &= MEMSIZE - 1;
+        return (mem[addr] << 16) | (mem[addr + 1] << 8) | mem[addr + 2];
+    }
+
+    void writeByte(int addr, int value)
+    {
+        addr &= MEMSIZE - 1;
+        mem[addr] = (uint8_t)value;
+        if (codemark[addr])
+            invalidate(addr);
+    }
+
+    void writeWord(int addr, int value)
+    {
+        addr &= MEMSIZE - 1;
+        mem[addr] = (uint8_t)(value >> 16);
+        mem[addr + 1] = (uint8_t)(value >> 8);
+        mem[addr + 2] = (uint8_t)value;
+        if (codemark[addr] | codemark[addr + 1] | codemark[addr + 2])
+            for (int i = 0; i < 3; i++)
+                invalidate(addr + i);
+    }
+
+    // drop every cached instruction that covers addr
+    void invalidate(int addr)
+    {
+        if (codemark[addr] & CODE_TRANSLATED)
+            codeWrites.push_back(addr);
+        for (int start = max(addr - 3, 0); start <= addr; start++)
+            if (cache[start].op != OP_DECODE && start + cache[start].length > addr)
+                cache[start].op = OP_DECODE;
+    }
+
+    // decode the instruction at pc, false if the opcode is unknown
+    bool decode(int pc, Decoded &d)
+    {
+        int b0 = mem[pc], b1 = mem[pc + 1], b2 = mem[pc + 2];
+        OpInfo info = optable[b0 & 0xFC];
+        if (info.id == OP_DECODE)
+            return false;
+
+        d.op = info.id;
+        d.mode = MODE_SIMPLE;
+        d.flags = 0;
+        d.r1 = d.r2 = 0;
+        d.addr = 0;
+
+        if (info.format == 1)
+            d.length = 1;
+        else if (info.format == 2)
+        {
+            d.length = 2;
+            d.r1 = b1 >> 4;
+            d.r2 = b1 & 0xF;
+
+            // CLEAR and TIXR take one register, the shifts a register and a count
+            bool second = d.op != OP_CLEAR && d.op != OP_TIXR && d.op != OP_SHIFTL && d.op != OP_SHIFTR;
+            if (!validRegister(d.r1) || (second && !validRegister(d.r2)))
+                d.op = OP_BADREG;
+        }
+        else
+        {
+            int ni = b0 & 3;
+            if (b1 & 0x80)
+                d.flags |= ADDR_X;
+
+            if (ni == 0)
+            {
+                // SIC format: 15-bit address
+                d.length = 3;
+                d.addr = ((b1 & 0x7F) << 8) | b2;
+            }
+            else
+            {
+                d.mode = (ni == 1) ? MODE_IMMEDIATE : (ni == 2) ? MODE_INDIRECT : MODE_SIMPLE;
+                if (b1 & 0x10)
+                {
+                    // format 4: 20-bit address
+                    d.length = 4;
+                    d.addr = ((b1 & 0x0F) << 16) | (b2 << 8) | mem[pc + 3];
+                }
+                else
+                {
+                    d.length = 3;
+                    int disp = ((b1 & 0x0F) << 8) | b2;
+                    if (b1 & 0x20)
+                        d.addr = pc + 3 + ((disp << 20) >> 20);
+                    else
+                    {
+                        d.addr = disp;
+                        if (b1 & 0x40)
+                            d.flags |= ADDR_BASE;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < d.length; i++)
+            codemark[pc + i] |= CODE_DECODED;
+        return true;
+    }
+
+    // write a byte to device dev (devXX.dat)
+    void deviceWrite(int dev, int byte)
+    {
+        if (captureOutput)
+        {
+            output[dev] += (char)byte;
+            return;
+        }
+        FILE *fp = openDevice(dev, "wb");
+        if (fp)
+            fputc(byte, fp);
+    }
+
+    // read a byte from device dev, 0 at end of file
+    int deviceRead(int dev)
+    {
+        FILE *fp = openDevice(dev, "rb");
+        int c = fp ? fgetc(fp) : EOF;
+        return c == EOF ? 0 : c;
+    }
+
+    FILE *openDevice(int dev, const char *mode)
+    {
+        if (!devices[dev])
+        {
+            stringstream path;
+            if (!deviceFiles[dev].empty())
+                path << deviceFiles[dev];
+            else
+                path << deviceDir << "dev" << hex << uppercase << setfill('0') << setw(2) << dev << ".dat";
+            devices[dev] = fopen(path.str().c_str(), mode);
+        }
+        return devices[dev];
+    }
+
+    void profileInstruction(int pc)
+    {
+        if (!profile->period)
+            profile->exec[pc]++;
+        else if (--profile->countdown == 0)
+        {
+            profile->exec[pc]++;
+            profile->countdown = profile->period;
+        }
+    }
+
+    void profileAccess(vector<uint64_t> &counts, int addr, int n)
+    {
+        if (!profile->period)
+            for (int i = 0; i < n; i++)
+                counts[(addr + i) & (MEMSIZE - 1)]++;
+    }
+
+    void profileCall(int start, int callee)
+    {
+        int caller = profile->stack.empty() ? start : profile->stack.back();
+        profile->calls[{caller, callee}]++;
+        profile->stack.push_back(callee);
+    }
+
+    void profileReturn()
+    {
+        profile->returns++;
+        if (!profile->stack.empty())
+            profile->stack.pop_back();
+    }
+
+    // memory access from the interpreter loop, counted when profiling
+    template <bool PROFILE>
+    int access(int addr, int n, bool write, int value)
+    {
+        if (PROFILE)
+            profileAccess(write ? profile->writes : profile->reads, addr, n);
+        if (write)
+        {
+            if (n == 3)
+                writeWord(addr, value);
+            else
+                writeByte(addr, value);
+            return 0;
+        }
+        return n == 3 ? readWord(addr) : readByte(addr);
+    }
+
+    // run from start until halt, error or limit instructions in total
+    int run(int start, long long limit)
+    {
+        return profile ? execute<true>(start, limit) : execute<false>(start, limit);
+    }
+
+    // interpreter loop, the profiling hooks compile away when PROFILE is false
+    template <bool PROFILE>
+    int execute(int start, long long limit)
+    {
+        static void *handlers[OP_COUNT] = {
+            &&do_DECODE,
+            &&do_LDA, &&do_LDX, &&do_LDL, &&do_LDB, &&do_LDS, &&do_LDT, &&do_LDCH, &&do_LDF,
+            &&do_STA, &&do_STX, &&do_STL, &&do_STB, &&do_STS, &&do_STT, &&do_STCH, &&do_STF, &&do_STSW,
+            &&do_ADD, &&do_SUB, &&do_MUL, &&do_DIV, &&do_COMP, &&do_AND, &&do_OR,
+            &&do_J, &&do_JEQ, &&do_JLT, &&do_JGT, &&do_JSUB, &&do_RSUB, &&do_TIX,
+            &&do_TD, &&do_RD, &&do_WD,
+            &&do_ADDR, &&do_SUBR, &&do_MULR, &&do_DIVR, &&do_COMPR, &&do_CLEAR, &&do_RMO, &&do_TIXR, &&do_SHIFTL, &&do_SHIFTR,
+            &&do_BADREG,
+        };
+
+        int *r = reg;
+        int PC = start;
+        int result = RUN_HALTED;
+        Decoded *d = NULL;
+        int ta = 0, value = 0;
+
+// fetch the next instruction and jump to its handler
+#define DISPATCH()                              \
+    do                                          \
+    {                                           \
+        if ((unsigned)PC >= (unsigned)MEMSIZE)  \
+            goto out_of_range;                  \
+        if (executed >= limit)                  \
+            goto limit_reached;                 \
+        executed++;                             \
+        if (PROFILE)                            \
+            profileInstruction(PC);             \
+        d = &cache[PC];                         \
+        goto *handlers[d->op];                  \
+    } while (0)
+
+// memory access, counted when profiling
+#define READ_WORD(a) access<PROFILE>(a, 3, false, 0)
+#define READ_BYTE(a) access<PROFILE>(a, 1, false, 0)
+#define WRITE_WORD(a, v) access<PROFILE>(a, 3, true, v)
+#define WRITE_BYTE(a, v) access<PROFILE>(a, 1, true, v)
+
+// handler entry, PC points past the instruction
+#define OP(name) \
+    do_##name:   \
+    PC += d->length;
+
+// target address before indirection
+#define TARGET() \
+    ((d->addr + ((d->flags & ADDR_X) ? r[REG_X] : 0) + ((d->flags & ADDR_BASE) ? r[REG_B] : 0)) & WORD_MASK)
+
+// effective address for stores and jumps
+#define EFFECTIVE() (ta = TARGET(), d->mode == MODE_INDIRECT ? READ_WORD(ta) : ta)
+
+// word operand
+#define OPERAND() (ta = TARGET(), d->mode == MODE_IMMEDIATE ? ta : READ_WORD(d->mode == MODE_INDIRECT ? READ_WORD(ta) : ta))
+
+// byte operand
+#define OPERAND_BYTE() (ta = TARGET(), d->mode == MODE_IMMEDIATE ? (ta & 0xFF) : READ_BYTE(d->mode == MODE_INDIRECT ? READ_WORD(ta) : ta))
+
+#define SET_CC(a, b) r[REG_SW] = (r[REG_SW] & ~3) | ((a) < (b) ? CC_LT : (a) > (b) ? CC_GT : CC_EQ)
+#define CC() (r[REG_SW] & 3)
+
+        DISPATCH();
+
+    do_DECODE:
+        if (!decode(PC, *d))
+        {
+            executed--;
+            error = "illegal instruction";
+            result = RUN_ERROR;
+            goto done;
+        }
+        goto *handlers[d->op];
+
+        // loads and stores
+        OP(LDA) r[REG_A] = OPERAND(); DISPATCH();
+        OP(LDX) r[REG_X] = OPERAND(); DISPATCH();
+        OP(LDL) r[REG_L] = OPERAND(); DISPATCH();
+        OP(LDB) r[REG_B] = OPERAND(); DISPATCH();
+        OP(LDS) r[REG_S] = OPERAND(); DISPATCH();
+        OP(LDT) r[REG_T] = OPERAND(); DISPATCH();
+        OP(LDCH) r[REG_A] = (r[REG_A] & 0xFFFF00) | OPERAND_BYTE(); DISPATCH();
+        OP(LDF)
+        {
+            int addr = EFFECTIVE();
+            F = ((uint64_t)READ_WORD(addr) << 24) | (uint64_t)READ_WORD(addr + 3);
+        }
+        DISPATCH();
+        OP(STA) WRITE_WORD(EFFECTIVE(), r[REG_A]); DISPATCH();
+        OP(STX) WRITE_WORD(EFFECTIVE(), r[REG_X]); DISPATCH();
+        OP(STL) WRITE_WORD(EFFECTIVE(), r[REG_L]); DISPATCH();
+        OP(STB) WRITE_WORD(EFFECTIVE(), r[REG_B]); DISPATCH();
+        OP(STS) WRITE_WORD(EFFECTIVE(), r[REG_S]); DISPATCH();
+        OP(STT) WRITE_WORD(EFFECTIVE(), r[REG_T]); DISPATCH();
+        OP(STCH) WRITE_BYTE(EFFECTIVE(), r[REG_A] & 0xFF); DISPATCH();
+        OP(STF)
+        {
+            int addr = EFFECTIVE();
+            WRITE_WORD(addr, (int)(F >> 24) & WORD_MASK);
+            WRITE_WORD(addr + 3, (int)F & WORD_MASK);
+        }
+        DISPATCH();
+        OP(STSW) WRITE_WORD(EFFECTIVE(), r[REG_SW]); DISPATCH();
+
+        // arithmetic
+        OP(ADD) r[REG_A] = (r[REG_A] + OPERAND()) & WORD_MASK; DISPATCH();
+        OP(SUB) r[REG_A] = (r[REG_A] - OPERAND()) & WORD_MASK; DISPATCH();
+        OP(MUL) r[REG_A] = (int)(((int64_t)signWord(r[REG_A]) * signWord(OPERAND())) & WORD_MASK); DISPATCH();
+        OP(DIV)
+            value = signWord(OPERAND());
+            if (value == 0)
+                goto divide_by_zero;
+            r[REG_A] = (signWord(r[REG_A]) / value) & WORD_MASK;
+            DISPATCH();
+        OP(COMP) value = signWord(OPERAND()); SET_CC(signWord(r[REG_A]), value); DISPATCH();
+        OP(AND) r[REG_A] &= OPERAND(); DISPATCH();
+        OP(OR) r[REG_A] |= OPERAND(); DISPATCH();
+        OP(TIX)
+            r[REG_X] = (r[REG_X] + 1) & WORD_MASK;
+            value = signWord(OPERAND());
+            SET_CC(signWord(r[REG_X]), value);
+            DISPATCH();
+
+        // jumps
+        OP(J)
+            value = EFFECTIVE();
+            if (value == PC - d->length)
+                goto done; // "J *" is the conventional halt
+            PC = value;
+            DISPATCH();
+        OP(JEQ) value = EFFECTIVE(); if (CC() == CC_EQ) PC = value; DISPATCH();
+        OP(JLT) value = EFFECTIVE(); if (CC() == CC_LT) PC = value; DISPATCH();
+        OP(JGT) value = EFFECTIVE(); if (CC() == CC_GT) PC = value; DISPATCH();
+        OP(JSUB)
+            value = EFFECTIVE();
+            if (PROFILE)
+                profileCall(start, value);
+            r[REG_L] = PC;
+            PC = value;
+            DISPATCH();
+        OP(RSUB)
+            if (PROFILE)
+                profileReturn();
+            PC = r[REG_L];
+            DISPATCH();
+
+        // devices are always ready
+        OP(TD) OPERAND_BYTE(); r[REG_SW] = (r[REG_SW] & ~3) | CC_LT; DISPATCH();
+        OP(RD) r[REG_A] = (r[REG_A] & 0xFFFF00) | deviceRead(OPERAND_BYTE()); DISPATCH();
+        OP(WD) deviceWrite(OPERAND_BYTE(), r[REG_A] & 0xFF); DISPATCH();
+
+        // register-register, PC and SW are visible through r[]
+        OP(ADDR) r[REG_PC] = PC; r[d->r2] = (r[d->r2] + r[d->r1]) & WORD_MASK; PC = r[REG_PC]; DISPATCH();
+        OP(SUBR) r[REG_PC] = PC; r[d->r2] = (r[d->r2] - r[d->r1]) & WORD_MASK; PC = r[REG_PC]; DISPATCH();
+        OP(MULR) r[REG_PC] = PC; r[d->r2] = (int)(((int64_t)signWord(r[d->r2]) * signWord(r[d->r1])) & WORD_MASK); PC = r[REG_PC]; DISPATCH();
+        OP(DIVR)
+            r[REG_PC] = PC;
+            if (signWord(r[d->r1]) == 0)
+                goto divide_by_zero;
+            r[d->r2] = (signWord(r[d->r2]) / signWord(r[d->r1])) & WORD_MASK;
+            PC = r[REG_PC];
+            DISPATCH();
+        OP(COMPR) r[REG_PC] = PC; SET_CC(signWord(r[d->r1]), signWord(r[d->r2])); DISPATCH();
+        OP(CLEAR) r[REG_PC] = PC; r[d->r1] = 0; PC = r[REG_PC]; DISPATCH();
+        OP(RMO) r[REG_PC] = PC; r[d->r2] = r[d->r1]; PC = r[REG_PC]; DISPATCH();
+        OP(TIXR)
+            r[REG_PC] = PC;
+            r[REG_X] = (r[REG_X] + 1) & WORD_MASK;
+            SET_CC(signWord(r[REG_X]), signWord(r[d->r1]));
+            DISPATCH();
+        OP(SHIFTL)
+            r[REG_PC] = PC;
+            value = d->r2 + 1;
+            r[d->r1] = (int)((((unsigned)r[d->r1] << value) | ((unsigned)r[d->r1] >> (24 - value))) & WORD_MASK);
+            PC = r[REG_PC];
+            DISPATCH();
+        OP(SHIFTR)
+            r[REG_PC] = PC;
+            r[d->r1] = (signWord(r[d->r1]) >> (d->r2 + 1)) & WORD_MASK;
+            PC = r[REG_PC];
+            DISPATCH();
+
+    do_BADREG:
+        executed--;
+        error = "invalid register";
+        result = RUN_ERROR;
+        goto done;
+
+    out_of_range:
+        if (PC != HALT_ADDR)
+        {
+            error = "jump outside memory";
+            result = RUN_ERROR;
+        }
+        goto done;
+
+    divide_by_zero:
+        error = "division by zero";
+        result = RUN_ERROR;
+        goto done;
+
+    limit_reached:
+        result = RUN_LIMIT;
+
+    done:
+        r[REG_PC] = PC;
+        return result;
+
+#undef DISPATCH
+#undef READ_WORD
+#undef READ_BYTE
+#undef WRITE_WORD
+#undef WRITE_BYTE
+#undef OP
+#undef TARGET
+#undef EFFECTIVE
+#undef OPERAND
+#undef OPERAND_BYTE
+#undef SET_CC
+#undef CC
+    }
+};
+
+#endif /* SICXE_MACHINE_H */
@@ -0,0 +1,8 @@
+#ifndef SICXE_MEMORY_H
+#define SICXE_MEMORY_H
+
+// size of the SIC/XE memory, shared by the INCBIN check in pass 1, the linker
+// loader's memory and the machine, so whatever assembles also loads and runs
+const int MEMSIZE = 1 << 20;
+
+#endif
@@ -0,0 +1,378 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <set>
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include "aot_runtime.h"
+
+using namespace std;
+
+// Ahead-of-time translator: reads memory.bin (linkloader -b), discovers the basic
+// blocks reachable from EXECADDR and writes translated.cpp, one C++ function per
+// block, then compiles it against aot_runtime.h into a native runner.
+
+Machine *machine;
+ImageHeader header;
+
+// block start -> one past its last byte
+map<int, int> blocks;
+
+string formatNumber(int num, int width)
+{
+    stringstream temp;
+    temp << hex << uppercase << setfill('0') << setw(width) << num;
+    return temp.str();
+}
+
+string hexNumber(int num)
+{
+    return "0x" + formatNumber(num, 6);
+}
+
+bool inImage(int addr)
+{
+    return addr >= (int)header.progaddr && addr < (int)(header.progaddr + header.length);
+}
+
+bool isJump(int op)
+{
+    return op == OP_J || op == OP_JEQ || op == OP_JLT || op == OP_JGT || op == OP_JSUB || op == OP_RSUB;
+}
+
+// instructions the code generator handles, the others are left to the interpreter
+bool translatable(const Decoded &d)
+{
+    if (d.op == OP_LDF || d.op == OP_STF)
+        return false;
+    if (d.length == 2 && (d.r1 == REG_PC || d.r2 == REG_PC))
+        return false;
+    return true;
+}
+
+// jump target known at translation time, -1 if it depends on registers or memory
+int staticTarget(const Decoded &d)
+{
+    if (d.flags || d.mode == MODE_INDIRECT || d.op == OP_RSUB)
+        return -1;
+    return d.addr;
+}
+
+// follow the control flow from EXECADDR and collect block leaders
+set<int> find_leaders()
+{
+    set<int> leaders, visited;
+    vector<int> worklist = {(int)header.execaddr};
+    leaders.insert(header.execaddr);
+
+    while (!worklist.empty())
+    {
+        int pc = worklist.back();
+        worklist.pop_back();
+
+        while (inImage(pc) && !visited.count(pc))
+        {
+            visited.insert(pc);
+            Decoded d;
+            if (!machine->decode(pc, d) || !translatable(d))
+                break;
+
+            int next = pc + d.length;
+            if (isJump(d.op))
+            {
+                int target = staticTarget(d);
+                if (target >= 0 && inImage(target))
+                {
+                    leaders.insert(target);
+                    worklist.push_back(target);
+                }
+                // conditional jumps fall through, subroutines return to the next instruction
+                if (d.op != OP_J && d.op != OP_RSUB && inImage(next))
+                {
+                    leaders.insert(next);
+                    worklist.push_back(next);
+                }
+                break;
+            }
+            pc = next;
+        }
+    }
+    return leaders;
+}
+
+// C++ expressions for the operands of a format 3/4 instruction
+string target(const Decoded &d)
+{
+    string t = hexNumber(d.addr);
+    if (d.flags & ADDR_X)
+        t += " + r[REG_X]";
+    if (d.flags & ADDR_BASE)
+        t += " + r[REG_B]";
+    if (d.flags)
+        t = "((" + t + ") & WORD_MASK)";
+    return t;
+}
+
+string effective(const Decoded &d)
+{
+    return d.mode == MODE_INDIRECT ? "m.readWord(" + target(d) + ")" : target(d);
+}
+
+string operand(const Decoded &d)
+{
+    if (d.mode == MODE_IMMEDIATE)
+        return target(d);
+    return "m.readWord(" + effective(d) + ")";
+}
+
+string operandByte(const Decoded &d)
+{
+    if (d.mode == MODE_IMMEDIATE)
+        return "(" + target(d) + " & 0xFF)";
+    return "m.readByte(" + effective(d) + ")";
+}
+
+// statement leaving the block after count instructions
+string leave(int count, string next)
+{
+    return "{ m.executed += " + to_string(count) + "; return " + next + "; }";
+}
+
+// translate one block, returns one past its last byte
+int emit_block(ostream &out, int start, const set<int> &leaders)
+{
+    // the body is written first, so r is only declared in blocks that use a register
+    stringstream body;
+    int pc = start, count = 0;
+    bool ended = false;
+    while (!ended)
+    {
+        Decoded d;
+        if (!inImage(pc) || (pc != start && leaders.count(pc)) || !machine->decode(pc, d) || !translatable(d))
+        {
+            body << "    " << leave(count, hexNumber(pc)) << "\n";
+            break;
+        }
+
+        count++;
+        int next = pc + d.length;
+        string reg[] = {"r[REG_A]", "r[REG_X]", "r[REG_L]", "r[REG_B]", "r[REG_S]", "r[REG_T]"};
+        string r1 = "r[" + to_string(d.r1) + "]", r2 = "r[" + to_string(d.r2) + "]";
+        stringstream s;
+
+        switch (d.op)
+        {
+        case OP_LDA: case OP_LDX: case OP_LDL: case OP_LDB: case OP_LDS: case OP_LDT:
+            s << reg[d.op - OP_LDA] << " = " << operand(d) << ";";
+            break;
+        case OP_LDCH:
+            s << "r[REG_A] = (r[REG_A] & 0xFFFF00) | " << operandByte(d) << ";";
+            break;
+        case OP_STA: case OP_STX: case OP_STL: case OP_STB: case OP_STS: case OP_STT: case OP_STCH: case OP_STSW:
+        {
+            string value = d.op == OP_STCH ? "r[REG_A] & 0xFF" : d.op == OP_STSW ? "r[REG_SW]" : reg[d.op - OP_STA];
+            s << (d.op == OP_STCH ? "m.writeByte(" : "m.writeWord(") << effective(d) << ", " << value << ");\n";
+            // a store into translated code ends the block so the runner can drop stale blocks
+            s << "    if (!m.codeWrites.empty()) " << leave(count, hexNumber(next));
+            break;
+        }
+        case OP_ADD:
+            s << "r[REG_A] = (r[REG_A] + " << operand(d) << ") & WORD_MASK;";
+            break;
+        case OP_SUB:
+            s << "r[REG_A] = (r[REG_A] - " << operand(d) << ") & WORD_MASK;";
+            break;
+        case OP_MUL:
+            s << "r[REG_A] = (int)(((int64_t)signWord(r[REG_A]) * signWord(" << operand(d) << ")) & WORD_MASK);";
+            break;
+        case OP_DIV:
+            s << "{\n        int v = signWord(" << operand(d) << ");\n"
+              << "        if (v == 0) { m.error = \"division by zero\"; r[REG_PC] = " << hexNumber(pc) << "; " << leave(count - 1, "AOT_ERROR") << " }\n"
+              << "        r[REG_A] = (signWord(r[REG_A]) / v) & WORD_MASK;\n    }";
+            break;
+        case OP_COMP:
+            s << "setCC(m, signWord(r[REG_A]), signWord(" << operand(d) << "));";
+            break;
+        case OP_AND:
+            s << "r[REG_A] &= " << operand(d) << ";";
+            break;
+        case OP_OR:
+            s << "r[REG_A] |= " << operand(d) << ";";
+            break;
+        case OP_TIX:
+            s << "r[REG_X] = (r[REG_X] + 1) & WORD_MASK;\n    setCC(m, signWord(r[REG_X]), signWord(" << operand(d) << "));";
+            break;
+        case OP_J:
+            if (staticTarget(d) == pc)
+                s << leave(count, "AOT_HALT");
+            else
+                s << leave(count, effective(d));
+            ended = true;
+            break;
+        case OP_JEQ: case OP_JLT: case OP_JGT:
+        {
+            string cc = d.op == OP_JEQ ? "CC_EQ" : d.op == OP_JLT ? "CC_LT" : "CC_GT";
+            s << "if ((r[REG_SW] & 3) == " << cc << ") " << leave(count, effective(d)) << "\n";
+            s << "    " << leave(count, hexNumber(next));
+            ended = true;
+            break;
+        }
+        case OP_JSUB:
+            s << "{\n        int target = " << effective(d) << ";\n        r[REG_L] = " << hexNumber(next) << ";\n        "
+              << leave(count, "target") << "\n    }";
+            ended = true;
+            break;
+        case OP_RSUB:
+            s << leave(count, "r[REG_L]");
+            ended = true;
+            break;
+        case OP_TD:
+            s << "r[REG_SW] = (r[REG_SW] & ~3) | CC_LT;";
+            break;
+        case OP_RD:
+            s << "r[REG_A] = (r[REG_A] & 0xFFFF00) | m.deviceRead(" << operandByte(d) << ");";
+            break;
+        case OP_WD:
+            s << "m.deviceWrite(" << operandByte(d) << ", r[REG_A] & 0xFF);";
+            break;
+        case OP_ADDR:
+            s << r2 << " = (" << r2 << " + " << r1 << ") & WORD_MASK;";
+            break;
+        case OP_SUBR:
+            s << r2 << " = (" << r2 << " - " << r1 << ") & WORD_MASK;";
+            break;
+        case OP_MULR:
+            s << r2 << " = (int)(((int64_t)signWord(" << r2 << ") * signWord(" << r1 << ")) & WORD_MASK);";
+            break;
+        case OP_DIVR:
+            s << "if (signWord(" << r1 << ") == 0) { m.error = \"division by zero\"; r[REG_PC] = " << hexNumber(pc) << "; "
+              << leave(count - 1, "AOT_ERROR") << " }\n"
+              << "    " << r2 << " = (signWord(" << r2 << ") / signWord(" << r1 << ")) & WORD_MASK;";
+            break;
+        case OP_COMPR:
+            s << "setCC(m, signWord(" << r1 << "), signWord(" << r2 << "));";
+            break;
+        case OP_CLEAR:
+            s << r1 << " = 0;";
+            break;
+        case OP_RMO:
+            s << r2 << " = " << r1 << ";";
+            break;
+        case OP_TIXR:
+            s << "r[REG_X] = (r[REG_X] + 1) & WORD_MASK;\n    setCC(m, signWord(r[REG_X]), signWord(" << r1 << "));";
+            break;
+        case OP_SHIFTL:
+            s << r1 << " = (int)((((unsigned)" << r1 << " << " << d.r2 + 1 << ") | ((unsigned)" << r1 << " >> " << 23 - d.r2 << ")) & WORD_MASK);";
+            break;
+        case OP_SHIFTR:
+            s << r1 << " = (signWord(" << r1 << ") >> " << d.r2 + 1 << ") & WORD_MASK;";
+            break;
+        case OP_BADREG:
+            // stop like the interpreter, before the instruction
+            s << "m.error = \"invalid register\"; r[REG_PC] = " << hexNumber(pc) << "; " << leave(count - 1, "AOT_ERROR");
+            ended = true;
+            break;
+        }
+
+        body << "    // " << formatNumber(pc, 6) << "\n";
+        body << "    " << s.str() << "\n";
+        pc = next;
+    }
+
+    out << "static int block_" << formatNumber(start, 6) << "(Machine &m)\n{\n";
+    if (body.str().find("r[") != string::npos)
+        out << "    int *r = m.reg;\n";
+    out << body.str() << "}\n\n";
+    return pc;
+}
+
+void write_translation(const string &file)
+{
+    set<int> leaders = find_leaders();
+
+    ofstream out(file);
+    if (!out.is_open())
+    {
+        perror(file.c_str());
+        exit(1);
+    }
+
+    out << "// generated by translator from memory.bin, do not edit\n";
+    out << "#include \"aot_runtime.h\"\n\n";
+
+    for (int start : leaders)
+    {
+        // the leader may not decode at all, then the interpreter reports the error
+        Decoded d;
+        if (!machine->decode(start, d) || !translatable(d))
+            continue;
+        blocks[start] = emit_block(out, start, leaders);
+    }
+
+    out << "static const int block_starts[] = {";
+    for (auto &b : blocks)
+        out << hexNumber(b.first) << ", ";
+    out << "0};\n";
+    out << "static const int block_ends[] = {";
+    for (auto &b : blocks)
+        out << hexNumber(b.second) << ", ";
+    out << "0};\n";
+    out << "static const BlockFn block_code[] = {";
+    for (auto &b : blocks)
+        out << "block_" << formatNumber(b.first, 6) << ", ";
+    out << "NULL};\n\n";
+
+    out << "int main(int argc, char *argv[])\n{\n";
+    out << "    Translation t = {" << hexNumber(header.progaddr) << ", " << header.length << ", "
+        << imageChecksum(*machine, header.progaddr, header.length) << "u, " << blocks.size() << ", block_starts, block_ends, block_code};\n";
+    out << "    return aot_main(argc, argv, t);\n}\n";
+    out.close();
+}
+
+int main(int argc, char *argv[])
+{
+    // usage: translator [-o runner] [-c] [image]; -c only writes translated.cpp
+    string image = "memory.bin", runner = "runner";
+    bool compile = true;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            runner = argv[++i];
+        else if (arg == "-c")
+            compile = false;
+        else
+            image = arg;
+    }
+
+    machine = new Machine();
+    if (!machine->loadOpTab("opTab.dat"))
+    {
+        perror("opTab.dat");
+        exit(1);
+    }
+    if (!machine->loadImage(image, header))
+    {
+        perror(image.c_str());
+        exit(1);
+    }
+
+    write_translation("translated.cpp");
+    cout << blocks.size() << " blocks translated to translated.cpp" << endl;
+
+    if (compile)
+    {
+        const char *cxx = getenv("CXX");
+        string command = string(cxx ? cxx : "g++") + " -O2 -o " + runner + " translated.cpp";
+        cout << command << endl;
+        if (system(command.c_str()) != 0)
+        {
+            perror("compilation failed");
+            exit(1);
+        }
+    }
+    return 0;
+}
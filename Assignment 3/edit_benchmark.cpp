@@ -0,0 +1,122 @@
+#include "incremental_lexer.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+/* Benchmark of incremental lexing: replays random keystrokes (typing, deleting
+   and pasting near the cursor, now and then jumping elsewhere) on a Pascal file
+   and compares every state of the document with a full lex of its text, tokens
+   and symbol references alike.
+
+   g++ -O2 edit_benchmark.cpp incremental_lexer.cpp simd_lexer.cpp symbol_table.cpp -o edit_benchmark
+   ./edit_benchmark bench.pas [edits] [edits between checks] */
+
+/* Lex the whole text and compare it with the document */
+bool check_document(const lexed_document* doc) {
+    vector<char> text(doc->length + SIMD_PADDING, 0);
+    copy_document_text(doc, 0, doc->length, text.data());
+
+    vector<int> references(symbol_count(), 0);
+    simd_lexer lexer;
+    init_simd_lexer(&lexer, text.data(), doc->length);
+    int token, i = 0, bump = -1;
+    while ((token = simd_lex(&lexer))) {
+        if (bump < 0)
+            bump = lexer.line == 0;
+        symbol* sym = (token == 22 || token == 23) ? (symbol*)lexer.yylval : nullptr;
+        if (sym != nullptr)
+            references.resize(symbol_count(), 0), references[sym->index]++;
+        if (i >= document_token_count(doc)) {
+            cerr << "document has " << i << " tokens, the text more" << endl;
+            return false;
+        }
+        lexed_token t = document_token(doc, i);
+        if (t.token != token || t.sym != sym || document_line(doc, i) != lexer.line + bump) {
+            cerr << "token " << i << " differs: " << t.token << " on line " << document_line(doc, i) << ", lexed " << token
+                 << " on line " << lexer.line + bump << endl;
+            return false;
+        }
+        i++;
+    }
+    if (i != document_token_count(doc)) {
+        cerr << "document has " << document_token_count(doc) << " tokens, the text " << i << endl;
+        return false;
+    }
+    for (int k = 0; k < symbol_count(); k++)
+        if (symbol_at(k)->references != (k < (int)references.size() ? references[k] : 0)) {
+            cerr << "symbol " << symbol_at(k)->specifier << " has " << symbol_at(k)->references << " references, the text "
+                 << references[k] << endl;
+            return false;
+        }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " file [edits] [edits between checks]" << endl;
+        return 1;
+    }
+    int edits = argc > 2 ? atoi(argv[2]) : 10000;
+    int check_every = argc > 3 ? atoi(argv[3]) : 1000;
+
+    ifstream in(argv[1]);
+    if (!in.is_open()) {
+        perror(argv[1]);
+        return 1;
+    }
+    string source((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    init_symbol_table();
+    lexed_document doc;
+    auto begin = chrono::steady_clock::now();
+    open_document(&doc, source.c_str(), source.length());
+    double full = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    cout << source.length() << " bytes, " << document_token_count(&doc) << " tokens, full lex " << full * 1e3 << " ms" << endl;
+
+    static const char* snippets[] = {"A", "X", "1", " ", "\n", ";", ":", "=", ".", "END", "SUM := SUM + 1;\n", "\tFOR I := 1 TO 10 DO\n"};
+    mt19937 random(42);
+    size_t cursor = doc.length / 2;
+    double total = 0;
+    vector<double> latencies;
+    long long lexed = 0;
+    for (int e = 1; e <= edits; e++) {
+        if (random() % 50 == 0)
+            cursor = random() % (doc.length + 1);
+        cursor = min(cursor, doc.length);
+
+        size_t start = cursor, end = cursor;
+        const char* text = "";
+        int kind = random() % 4;
+        if (kind == 0 && cursor > 0)
+            start = cursor - 1; // backspace
+        else if (kind == 1)
+            end = min(doc.length, cursor + 1 + random() % 8); // delete a few bytes
+        if (kind != 0)
+            text = snippets[random() % (sizeof(snippets) / sizeof(snippets[0]))];
+
+        auto edit_begin = chrono::steady_clock::now();
+        lexed += edit_document(&doc, start, end, text, strlen(text));
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - edit_begin).count();
+        total += seconds;
+        latencies.push_back(seconds);
+        cursor = start + strlen(text);
+
+        if ((check_every > 0 && e % check_every == 0) || e == edits) {
+            if (!check_document(&doc)) {
+                cerr << "after edit " << e << endl;
+                return 1;
+            }
+        }
+    }
+
+    // jumps move the gaps across the document, edits at the cursor do not
+    sort(latencies.begin(), latencies.end());
+    cout << edits << " edits: median " << latencies[edits / 2] * 1e6 << " us, mean " << total / edits * 1e6 << " us, worst "
+         << latencies.back() * 1e6 << " us, " << (double)lexed / edits << " tokens lexed per edit" << endl;
+    cout << "every check against a full lex passed" << endl;
+    close_document(&doc);
+    free_symbol_table();
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "incremental_lexer.h"
+
+/* Incremental lexing: an edit replaces a range of the text, then the document is
+   lexed again from the end of the last token before the edit, one window at a
+   time, until a new token starts where an old token after the edit starts and
+   is the same token. The language has no comments or strings, so every token
+   boundary is a safe place to restart and everything after a match is unchanged.
+   Token references of the symbols are counted as tokens come and go. */
+
+/* Length of tokens 1 to 21, identifiers and integers have the length of their symbol */
+static const int TOKEN_LENGTH[24] = {0, 7, 3, 5, 3, 4, 7, 3, 4, 5, 2, 2, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 0, 0};
+
+static char text_at(const lexed_document* doc, size_t i) {
+    return i < doc->text_gap_start ? doc->text[i] : doc->text[i + doc->text_gap_end - doc->text_gap_start];
+}
+
+/* Copy bytes [start, end) of the document */
+void copy_document_text(const lexed_document* doc, size_t start, size_t end, char* out) {
+    size_t before = start < doc->text_gap_start ? (end < doc->text_gap_start ? end : doc->text_gap_start) - start : 0;
+    memcpy(out, doc->text + start, before);
+    size_t gap = doc->text_gap_end - doc->text_gap_start;
+    memcpy(out + before, doc->text + start + before + gap, end - start - before);
+}
+
+/* Move the text gap to pos and make it at least size bytes long */
+static void move_text_gap(lexed_document* doc, size_t pos, size_t size) {
+    size_t gap = doc->text_gap_end - doc->text_gap_start;
+    if (gap < size) {
+        size_t capacity = 2 * doc->text_capacity + size;
+        size_t after = doc->text_capacity - doc->text_gap_end;
+        doc->text = (char*)realloc(doc->text, capacity);
+        memmove(doc->text + capacity - after, doc->text + doc->text_gap_end, after);
+        doc->text_gap_end = capacity - after;
+        doc->text_capacity = capacity;
+        gap = doc->text_gap_end - doc->text_gap_start;
+    }
+    if (pos < doc->text_gap_start)
+        memmove(doc->text + pos + gap, doc->text + pos, doc->text_gap_start - pos);
+    else
+        memmove(doc->text + doc->text_gap_start, doc->text + doc->text_gap_end, pos - doc->text_gap_start);
+    doc->text_gap_start = pos;
+    doc->text_gap_end = pos + gap;
+}
+
+/* Token i with its offset and newlines counted from the start */
+lexed_token document_token(const lexed_document* doc, int i) {
+    if (i < doc->token_gap_start)
+        return doc->tokens[i];
+    lexed_token t = doc->tokens[i + doc->token_gap_end - doc->token_gap_start];
+    t.offset = doc->length - t.offset;
+    t.newlines = doc->newlines - t.newlines;
+    return t;
+}
+
+int document_token_count(const lexed_document* doc) {
+    return doc->token_capacity - (doc->token_gap_end - doc->token_gap_start);
+}
+
+/* Line of token i as the flex scanner reports it: the first token is on line 1 */
+int document_line(const lexed_document* doc, int i) {
+    return document_token(doc, i).newlines + (document_token(doc, 0).newlines == 0);
+}
+
+/* Move the token gap in front of token i, converting the tokens that cross it */
+static void move_token_gap(lexed_document* doc, int i) {
+    while (doc->token_gap_start > i) {
+        lexed_token t = doc->tokens[--doc->token_gap_start];
+        t.offset = doc->length - t.offset;
+        t.newlines = doc->newlines - t.newlines;
+        doc->tokens[--doc->token_gap_end] = t;
+    }
+    while (doc->token_gap_start < i) {
+        lexed_token t = doc->tokens[doc->token_gap_end++];
+        t.offset = doc->length - t.offset;
+        t.newlines = doc->newlines - t.newlines;
+        doc->tokens[doc->token_gap_start++] = t;
+    }
+}
+
+/* Add a token in front of the gap */
+static void push_token(lexed_document* doc, lexed_token t) {
+    if (doc->token_gap_start == doc->token_gap_end) {
+        int capacity = 2 * doc->token_capacity + 64;
+        int after = doc->token_capacity - doc->token_gap_end;
+        doc->tokens = (lexed_token*)realloc(doc->tokens, capacity * sizeof(lexed_token));
+        memmove(doc->tokens + capacity - after, doc->tokens + doc->token_gap_end, after * sizeof(lexed_token));
+        doc->token_gap_end = capacity - after;
+        doc->token_capacity = capacity;
+    }
+    if (t.sym != nullptr)
+        t.sym->references++;
+    doc->tokens[doc->token_gap_start++] = t;
+}
+
+/* Drop the first token after the gap */
+static void drop_token(lexed_document* doc) {
+    symbol* sym = doc->tokens[doc->token_gap_end++].sym;
+    if (sym != nullptr)
+        sym->references--;
+}
+
+/* Start an empty document and lex its text */
+void open_document(lexed_document* doc, const char* text, size_t size) {
+    memset(doc, 0, sizeof(lexed_document));
+    edit_document(doc, 0, 0, text, size);
+}
+
+/* Replace bytes [start, end) with size bytes of text and lex the document again
+   around them. Returns the number of tokens lexed. */
+int edit_document(lexed_document* doc, size_t start, size_t end, const char* text, size_t size) {
+    if (start > end || end > doc->length) {
+        cerr << "edit [" << start << ", " << end << ") outside the document" << endl;
+        exit(1);
+    }
+
+    // the first token that ends at or after the edit may change, lex from the end of the one before
+    int lo = 0, hi = document_token_count(doc);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        lexed_token t = document_token(doc, mid);
+        if (t.offset + t.length < start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    move_token_gap(doc, lo);
+    size_t pos = 0;
+    int newlines = 0;
+    if (lo > 0) {
+        lexed_token before = doc->tokens[lo - 1];
+        pos = before.offset + before.length;
+        newlines = before.newlines;
+    }
+
+    // tokens that start inside the replaced bytes are gone
+    while (doc->token_gap_end < doc->token_capacity && doc->length - doc->tokens[doc->token_gap_end].offset < end)
+        drop_token(doc);
+
+    // replace the text; the tokens after the gap follow the end of the document
+    for (size_t i = start; i < end; i++)
+        doc->newlines -= text_at(doc, i) == '\n';
+    for (size_t i = 0; i < size; i++)
+        doc->newlines += text[i] == '\n';
+    move_text_gap(doc, start, size);
+    doc->text_gap_end += end - start;
+    memcpy(doc->text + start, text, size);
+    doc->text_gap_start += size;
+    doc->length += size - (end - start);
+
+    // lex windows that end at a blank, so no token is cut off, until a token matches
+    int lexed = 0;
+    char* window = (char*)malloc(RELEX_WINDOW + SIMD_PADDING);
+    size_t window_size = RELEX_WINDOW;
+    while (pos < doc->length) {
+        size_t window_end = pos + RELEX_WINDOW;
+        if (window_end >= doc->length)
+            window_end = doc->length;
+        while (window_end < doc->length && text_at(doc, window_end) != ' ' && text_at(doc, window_end) != '\t' &&
+               text_at(doc, window_end) != '\n')
+            window_end++;
+        if (window_end - pos > window_size) {
+            window_size = window_end - pos;
+            window = (char*)realloc(window, window_size + SIMD_PADDING);
+        }
+        copy_document_text(doc, pos, window_end, window);
+        memset(window + (window_end - pos), 0, SIMD_PADDING);
+
+        simd_lexer lexer;
+        init_simd_lexer(&lexer, window, window_end - pos);
+        lexer.line = newlines;
+        int token;
+        while ((token = simd_lex(&lexer))) {
+            // the lexer stopped right after the token
+            size_t length = (token == 22 || token == 23) ? ((symbol*)lexer.yylval)->length : TOKEN_LENGTH[token];
+            size_t offset = pos + (lexer.pos - window) - length;
+
+            // old tokens the new ones passed are gone, an equal old token ends the edit
+            while (doc->token_gap_end < doc->token_capacity && doc->length - doc->tokens[doc->token_gap_end].offset < offset)
+                drop_token(doc);
+            if (doc->token_gap_end < doc->token_capacity) {
+                lexed_token old = doc->tokens[doc->token_gap_end];
+                if (doc->length - old.offset == offset && old.token == token && old.length == (int)length) {
+                    free(window);
+                    return lexed;
+                }
+            }
+
+            symbol* sym = (token == 22 || token == 23) ? (symbol*)lexer.yylval : nullptr;
+            push_token(doc, {token, (int)length, offset, lexer.line, sym});
+            lexed++;
+        }
+        newlines = lexer.line;
+        pos = window_end;
+    }
+    free(window);
+
+    // the end of the document was reached, nothing old is left
+    while (doc->token_gap_end < doc->token_capacity)
+        drop_token(doc);
+    return lexed;
+}
+
+/* Release the document, the symbols lose its references */
+void close_document(lexed_document* doc) {
+    move_token_gap(doc, document_token_count(doc));
+    for (int i = 0; i < doc->token_gap_start; i++)
+        if (doc->tokens[i].sym != nullptr)
+            doc->tokens[i].sym->references--;
+    free(doc->text);
+    free(doc->tokens);
+    memset(doc, 0, sizeof(lexed_document));
+}
@@ -0,0 +1,39 @@
+#ifndef INCREMENTAL_LEXER_H
+#define INCREMENTAL_LEXER_H
+
+#include "simd_lexer.h"
+
+#define RELEX_WINDOW 4096 /* bytes copied out of the document at a time when re-lexing */
+
+/* Define the token of a document */
+typedef struct lexed_token {
+    int token;
+    int length;
+    size_t offset; // first byte of the token
+    int newlines;  // newlines before the token
+    symbol* sym;   // identifier or integer, nullptr for other tokens
+} lexed_token;
+
+/* A document kept lexed while it is edited. The text and the tokens are gap
+   buffers with the gap at the last edit. Tokens after the gap store offset and
+   newlines counted back from the end of the document, so an edit does not have
+   to touch them. */
+typedef struct lexed_document {
+    char* text;
+    size_t text_capacity, text_gap_start, text_gap_end;
+    lexed_token* tokens;
+    int token_capacity, token_gap_start, token_gap_end;
+    size_t length; // bytes of the document
+    int newlines;  // newlines of the document
+} lexed_document;
+
+/* Function prototypes for incremental lexing */
+void open_document(lexed_document* doc, const char* text, size_t size);
+int edit_document(lexed_document* doc, size_t start, size_t end, const char* text, size_t size);
+int document_token_count(const lexed_document* doc);
+lexed_token document_token(const lexed_document* doc, int i);
+int document_line(const lexed_document* doc, int i);
+void copy_document_text(const lexed_document* doc, size_t start, size_t end, char* out);
+void close_document(lexed_document* doc);
+
+#endif /* INCREMENTAL_LEXER_H */
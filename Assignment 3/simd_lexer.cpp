@@ -0,0 +1,177 @@
+#include "simd_lexer.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Hand-written lexer for the same language as lexicalAnalyser.l. It returns the
+   same token ids and installs the same symbols as the flex rules. Runs of blanks,
+   identifiers and numbers are found 16 bytes at a time with SSE2 compares, and
+   an identifier is looked up as a keyword with one perfect hash probe. The text
+   must be followed by SIMD_PADDING zero bytes, so the 16-byte loads never leave
+   the buffer. */
+
+typedef struct keyword {
+    const char* text;
+    int length;
+    int token;
+} keyword;
+
+static constexpr int keyword_hash(const char* text, int length) {
+    return ((unsigned char)text[0] + 3 * (unsigned char)text[length - 1] + length) & 31;
+}
+
+/* Keywords by (first + 3 * last + length) & 31, which has no collisions for this set.
+   The table is built at compile time and never written, so lexers on any thread share it. */
+struct keyword_table {
+    keyword slots[32] = {};
+
+    constexpr keyword_table() {
+        const keyword list[] = {{"PROGRAM", 7, 1}, {"VAR", 3, 2}, {"BEGIN", 5, 3}, {"END", 3, 4}, {"INTEGER", 7, 6}, {"FOR", 3, 7},
+                                {"READ", 4, 8}, {"WRITE", 5, 9}, {"TO", 2, 10}, {"DO", 2, 11}, {"DIV", 3, 19}};
+        for (const keyword& k : list)
+            slots[keyword_hash(k.text, k.length)] = k;
+    }
+};
+
+static constexpr keyword_table KEYWORDS;
+
+static int keyword_token(const char* text, int length) {
+    const keyword& k = KEYWORDS.slots[keyword_hash(text, length)];
+    return k.length == length && !memcmp(k.text, text, length) ? k.token : 0;
+}
+
+static bool is_alpha(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+#ifdef __SSE2__
+/* Bit i is set when byte i of v is in [lo, hi] */
+static inline unsigned in_range(__m128i v, char lo, char hi) {
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(128 - lo)));
+    return _mm_movemask_epi8(_mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + hi - lo + 1))));
+}
+
+static inline unsigned equal(__m128i v, char c) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+#endif
+
+/* End of the letters and digits starting at p */
+static const char* skip_alnum(const char* p) {
+#ifdef __SSE2__
+    while (true) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        // setting bit 5 maps A-Z onto a-z and nothing else onto them
+        unsigned mask = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z') | in_range(v, '0', '9');
+        if (mask != 0xFFFF)
+            return p + __builtin_ctz(~mask);
+        p += 16;
+    }
+#else
+    while (is_alpha(*p) || is_digit(*p))
+        p++;
+    return p;
+#endif
+}
+
+/* End of the digits starting at p */
+static const char* skip_digits(const char* p) {
+#ifdef __SSE2__
+    while (true) {
+        unsigned mask = in_range(_mm_loadu_si128((const __m128i*)p), '0', '9');
+        if (mask != 0xFFFF)
+            return p + __builtin_ctz(~mask);
+        p += 16;
+    }
+#else
+    while (is_digit(*p))
+        p++;
+    return p;
+#endif
+}
+
+/* End of the spaces, tabs and newlines starting at p, counting the newlines */
+static const char* skip_blanks(const char* p, int* line) {
+#ifdef __SSE2__
+    while (true) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned newlines = equal(v, '\n');
+        unsigned mask = newlines | equal(v, ' ') | equal(v, '\t');
+        int n = __builtin_ctz(~mask);
+        *line += __builtin_popcount(newlines & ((1u << n) - 1));
+        p += n;
+        if (n < 16)
+            return p;
+    }
+#else
+    for (; *p == ' ' || *p == '\t' || *p == '\n'; p++)
+        if (*p == '\n')
+            (*line)++;
+    return p;
+#endif
+}
+
+/* Start lexing a text followed by SIMD_PADDING zero bytes */
+void init_simd_lexer(simd_lexer* lexer, const char* text, size_t size) {
+    lexer->pos = text;
+    lexer->end = text + size;
+    lexer->line = 0;
+    lexer->yylval = nullptr;
+}
+
+/* Next token id, 0 at the end of the text */
+int simd_lex(simd_lexer* lexer) {
+    const char* p = lexer->pos;
+    while (true) {
+        p = skip_blanks(p, &lexer->line);
+        if (p >= lexer->end) {
+            lexer->pos = lexer->end;
+            return 0;
+        }
+
+        char c = *p;
+        if (is_alpha(c)) {
+            const char* q = skip_alnum(p + 1);
+            int token = keyword_token(p, q - p);
+            // "END." is longer than the identifier END, so flex prefers it
+            if (token == 4 && *q == '.') {
+                lexer->pos = q + 1;
+                return 5;
+            }
+            lexer->pos = q;
+            if (token)
+                return token;
+            lexer->yylval = install_symbol(p, q - p, '^');
+            return 22;
+        }
+        if (is_digit(c)) {
+            const char* q = skip_digits(p + 1);
+            lexer->pos = q;
+            lexer->yylval = install_symbol(p, q - p, '#');
+            return 23;
+        }
+
+        p++;
+        lexer->pos = p;
+        switch (c) {
+        case ';': return 12;
+        case ':':
+            if (*p == '=') {
+                lexer->pos = p + 1;
+                return 15;
+            }
+            return 13;
+        case ',': return 14;
+        case '+': return 16;
+        case '-': return 17;
+        case '*': return 18;
+        case '(': return 20;
+        case ')': return 21;
+        }
+        // anything else is skipped like the "." rule
+    }
+}
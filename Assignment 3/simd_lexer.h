@@ -0,0 +1,20 @@
+#ifndef SIMD_LEXER_H
+#define SIMD_LEXER_H
+
+#include "symbol_table.h"
+
+#define SIMD_PADDING 32 /* zero bytes the input needs after its end */
+
+/* Define the state of the hand-written lexer */
+typedef struct simd_lexer {
+    const char* pos;
+    const char* end;
+    int line;     // line number, counted from newlines like the flex scanner
+    void* yylval; // symbol of the last identifier or integer
+} simd_lexer;
+
+/* Function prototypes for the hand-written lexer */
+void init_simd_lexer(simd_lexer* lexer, const char* text, size_t size);
+int simd_lex(simd_lexer* lexer);
+
+#endif /* SIMD_LEXER_H */
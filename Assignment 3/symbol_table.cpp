@@ -1,55 +1,238 @@
 #include "symbol_table.h"
+#include <mutex>
 
-/* Define the symbol table array */
-symbol* SYMTAB[SIZE];
+/* The symbol table is an open addressing table with Robin Hood probing. Every slot
+   keeps the hash of its symbol, and an insert takes over the slot of a symbol that
+   is closer to its home slot, so probe sequences stay short. The table doubles
+   when it is 3/4 full.
 
-/* Hash function to compute bucket index */
-int hash_function(char* specifier) {
-    int len = strlen(specifier);
-    int hash = 0;
-    for (int i = 0; i < len; i++) 
-        hash += (int)specifier[i];
-    return hash % SIZE;
+   The table is split into SHARDS shards by the top bits of the hash. Every shard
+   has its own lock and arena, so scanners lexing different files in parallel
+   rarely wait for each other. Symbol indexes come from one counter, so a symbol
+   has the same index in every file. */
+#define SHARDS 64
+
+typedef struct slot {
+    symbol* sym; /* nullptr for an empty slot */
+    unsigned long long hash;
+} slot;
+
+/* Symbols and their specifiers are bump-allocated from large blocks, which are
+   only released together by free_symbol_table(). */
+#define ARENA_BLOCK (1 << 16)
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t used, size;
+} arena_block;
+
+typedef struct shard {
+    mutex lock;
+    slot* slots;
+    int size;           /* number of slots, a power of two */
+    int symbols;        /* number of symbols in the shard */
+    arena_block* arena; /* block being filled, earlier blocks follow next */
+} shard;
+
+shard SYMTAB[SHARDS];
+
+mutex order_lock;         /* guards ORDER and symbols */
+symbol** ORDER = nullptr; /* symbols by index */
+int order_size = 0;
+int symbols = 0; /* number of symbols in the table */
+
+static void* arena_alloc(shard* s, size_t bytes) {
+    bytes = (bytes + 7) & ~(size_t)7;
+    if (s->arena == nullptr || s->arena->used + bytes > s->arena->size) {
+        size_t size = bytes > ARENA_BLOCK ? bytes : ARENA_BLOCK;
+        arena_block* block = (arena_block*)malloc(sizeof(arena_block) + size);
+        if (block == nullptr) {
+            cerr << "Out of memory for the symbol table" << endl;
+            exit(1);
+        }
+        block->next = s->arena;
+        block->used = 0;
+        block->size = size;
+        s->arena = block;
+    }
+    void* memory = (char*)(s->arena + 1) + s->arena->used;
+    s->arena->used += bytes;
+    return memory;
+}
+
+/* 64-bit FNV-1a with a final mix, so that similar identifiers spread over the table */
+unsigned long long hash_function(const char* specifier, int length) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)specifier[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/* Shard of a hash, the low bits pick the slot inside it */
+static shard* shard_of(unsigned long long hash) {
+    return &SYMTAB[hash >> 58];
+}
+
+/* How far slot i is from the home slot of a hash */
+static int probe_distance(shard* s, unsigned long long hash, int i) {
+    return (i - (int)(hash & (s->size - 1))) & (s->size - 1);
+}
+
+/* Put an entry in a shard, moving richer entries on */
+static void place(shard* s, slot entry) {
+    int i = entry.hash & (s->size - 1);
+    for (int dist = 0;; dist++, i = (i + 1) & (s->size - 1)) {
+        if (s->slots[i].sym == nullptr) {
+            s->slots[i] = entry;
+            return;
+        }
+        int other = probe_distance(s, s->slots[i].hash, i);
+        if (other < dist) {
+            slot temp = s->slots[i];
+            s->slots[i] = entry;
+            entry = temp;
+            dist = other;
+        }
+    }
+}
+
+/* Double the number of slots of a shard and put every symbol back */
+static void grow(shard* s) {
+    slot* old = s->slots;
+    int old_size = s->size;
+    s->size *= 2;
+    s->slots = (slot*)calloc(s->size, sizeof(slot));
+    for (int i = 0; i < old_size; i++)
+        if (old[i].sym != nullptr)
+            place(s, old[i]);
+    free(old);
 }
 
 /* Initialize symbol table */
 void init_symbol_table() {
-    for (int i = 0; i < SIZE; i++) 
-        SYMTAB[i] = nullptr;
+    free_symbol_table();
+    for (int i = 0; i < SHARDS; i++) {
+        SYMTAB[i].size = SIZE;
+        SYMTAB[i].slots = (slot*)calloc(SIZE, sizeof(slot));
+    }
+}
+
+/* Find a symbol in a locked shard, compared by length before the bytes */
+static symbol* find(shard* s, const char* specifier, int length, unsigned long long hash) {
+    int i = hash & (s->size - 1);
+    for (int dist = 0;; dist++, i = (i + 1) & (s->size - 1)) {
+        // an empty slot or a richer entry ends the probe sequence
+        if (s->slots[i].sym == nullptr || probe_distance(s, s->slots[i].hash, i) < dist)
+            return nullptr;
+        symbol* sym = s->slots[i].sym;
+        if (s->slots[i].hash == hash && sym->length == length && !memcmp(sym->specifier, specifier, length))
+            return sym;
+    }
+}
+
+/* Add a symbol to a locked shard, its specifier is copied next to it in the arena */
+static symbol* add(shard* s, const char* specifier, int length, unsigned long long hash, char type) {
+    if (4 * (s->symbols + 1) > 3 * s->size)
+        grow(s);
+    symbol* new_symbol = (symbol*)arena_alloc(s, sizeof(symbol) + length + 1);
+    new_symbol->specifier = (char*)(new_symbol + 1);
+    memcpy(new_symbol->specifier, specifier, length);
+    new_symbol->specifier[length] = '\0';
+    new_symbol->length = length;
+    new_symbol->hash = hash;
+    new_symbol->type = type;
+    new_symbol->references = 0;
+
+    // the index is set before other scanners can find the symbol
+    {
+        lock_guard<mutex> guard(order_lock);
+        if (symbols == order_size) {
+            order_size = order_size ? 2 * order_size : SIZE;
+            ORDER = (symbol**)realloc(ORDER, order_size * sizeof(symbol*));
+        }
+        new_symbol->index = symbols;
+        ORDER[symbols++] = new_symbol;
+    }
+
+    place(s, {new_symbol, hash});
+    s->symbols++;
+    return new_symbol;
 }
 
 /* Search for a symbol in the symbol table */
 symbol* search_symbol(char* specifier) {
-    int i = hash_function(specifier);
-    symbol* temp = SYMTAB[i];
-    while (temp != nullptr && strcmp(temp->specifier, specifier))
-        temp = temp->next;
-    return temp;
+    int length = strlen(specifier);
+    unsigned long long hash = hash_function(specifier, length);
+    shard* s = shard_of(hash);
+    lock_guard<mutex> guard(s->lock);
+    return find(s, specifier, length, hash);
 }
 
 /* Insert a new symbol into the symbol table */
 symbol* insert_symbol(char* specifier, char type) {
-    int i = hash_function(specifier);
-    symbol* new_symbol = (symbol*)malloc(sizeof(symbol));
-    new_symbol->specifier = (char*)strdup(specifier);
-    new_symbol->type = type;
-    new_symbol->next = SYMTAB[i];
-    SYMTAB[i] = new_symbol;
-    return new_symbol;
+    int length = strlen(specifier);
+    unsigned long long hash = hash_function(specifier, length);
+    shard* s = shard_of(hash);
+    lock_guard<mutex> guard(s->lock);
+    return add(s, specifier, length, hash, type);
+}
+
+/* Return the symbol of a specifier, inserting it the first time; the lexer passes
+   yytext and yyleng, so the text is hashed once and never scanned for its end */
+symbol* install_symbol(const char* specifier, int length, char type) {
+    unsigned long long hash = hash_function(specifier, length);
+    shard* s = shard_of(hash);
+    lock_guard<mutex> guard(s->lock);
+    symbol* sym = find(s, specifier, length, hash);
+    if (sym == nullptr)
+        sym = add(s, specifier, length, hash, type);
+    return sym;
 }
 
 /* Print the contents of the symbol table */
 void print_symbol_table() {
+    int slots = 0;
+    for (int i = 0; i < SHARDS; i++)
+        slots += SYMTAB[i].size;
     cout << "-------------------------------------\n";
-    cout << "SYMTAB\n";
-    for (int i = 0; i < SIZE; i++) {
-        cout << "bucket [" << i << "]: ";
-        symbol* temp = SYMTAB[i];
-        while (temp != nullptr) {
-            cout << temp->type << temp->specifier << " -> ";
-            temp = temp->next;
+    cout << "SYMTAB (" << symbols << " symbols in " << slots << " slots)\n";
+    for (int i = 0; i < symbols; i++)
+        cout << "symbol [" << i << "]: " << ORDER[i]->type << ORDER[i]->specifier << "\n";
+    cout << "-------------------------------------\n";
+}
+
+/* Release the table and every symbol at once */
+void free_symbol_table() {
+    for (int i = 0; i < SHARDS; i++) {
+        shard* s = &SYMTAB[i];
+        while (s->arena != nullptr) {
+            arena_block* next = s->arena->next;
+            free(s->arena);
+            s->arena = next;
         }
-        cout << "nullptr\n";
+        free(s->slots);
+        s->slots = nullptr;
+        s->size = 0;
+        s->symbols = 0;
     }
-    cout << "-------------------------------------\n";
+    free(ORDER);
+    ORDER = nullptr;
+    order_size = 0;
+    symbols = 0;
+}
+
+/* Number of symbols and the symbol with a given index */
+int symbol_count() {
+    lock_guard<mutex> guard(order_lock);
+    return symbols;
+}
+
+symbol* symbol_at(int index) {
+    lock_guard<mutex> guard(order_lock);
+    return ORDER[index];
 }
@@ -1,7 +1,7 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
-#define SIZE 20
+#define SIZE 16 /* initial number of slots of a shard, a power of two */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,17 +12,25 @@
 
 using namespace std;
 
-/* Define the symbol structure */
+/* Define the symbol structure, the specifier is stored right after it */
 typedef struct symbol {
     char* specifier;
+    int length;              /* length of the specifier */
+    unsigned long long hash; /* hash_function of the specifier */
     char type;
-    struct symbol* next;
+    int index;               /* order of insertion, from 0 */
+    int references;          /* tokens of open documents that name the symbol */
 } symbol;
 
 /* Function prototypes for symbol table operations */
 void init_symbol_table();
+unsigned long long hash_function(const char* specifier, int length);
 symbol* search_symbol(char* specifier);
 symbol* insert_symbol(char* specifier, char type);
+symbol* install_symbol(const char* specifier, int length, char type);
 void print_symbol_table();
+void free_symbol_table();
+int symbol_count();
+symbol* symbol_at(int index);
 
 #endif /* SYMBOL_TABLE_H */
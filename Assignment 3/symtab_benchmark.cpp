@@ -0,0 +1,156 @@
+#include "symbol_table.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cctype>
+
+/* Benchmark of the symbol table: writes a Pascal program with the given number of
+   identifiers (bench.pas), takes its identifiers and numbers the way the lexer
+   does and installs them in the old 20-bucket chained table and in symbol_table.cpp.
+
+   g++ -O2 symtab_benchmark.cpp symbol_table.cpp -o symtab_benchmark
+   ./symtab_benchmark [identifiers] [distinct identifiers] */
+
+/* The chained table symbol_table.cpp used before */
+#define CHAINED_SIZE 20
+
+typedef struct chained_symbol {
+    char* specifier;
+    char type;
+    struct chained_symbol* next;
+} chained_symbol;
+
+chained_symbol* CHAINED[CHAINED_SIZE];
+
+int chained_hash(char* specifier) {
+    int len = strlen(specifier);
+    int hash = 0;
+    for (int i = 0; i < len; i++)
+        hash += (int)specifier[i];
+    return hash % CHAINED_SIZE;
+}
+
+chained_symbol* chained_search(char* specifier) {
+    chained_symbol* temp = CHAINED[chained_hash(specifier)];
+    while (temp != nullptr && strcmp(temp->specifier, specifier))
+        temp = temp->next;
+    return temp;
+}
+
+chained_symbol* chained_insert(char* specifier, char type) {
+    int i = chained_hash(specifier);
+    chained_symbol* new_symbol = (chained_symbol*)malloc(sizeof(chained_symbol));
+    new_symbol->specifier = (char*)strdup(specifier);
+    new_symbol->type = type;
+    new_symbol->next = CHAINED[i];
+    CHAINED[i] = new_symbol;
+    return new_symbol;
+}
+
+/* Name of identifier k: X followed by base 36 digits, so it is never a keyword */
+string identifier(long long k) {
+    unsigned long long x = (unsigned long long)k * 2654435761ULL % 4294967291ULL;
+    string name = "X";
+    do {
+        name += "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[x % 36];
+        x /= 36;
+    } while (x);
+    return name;
+}
+
+/* A program in the language of the lexer with about n identifiers out of distinct names */
+void write_program(const char* file, long long n, long long distinct) {
+    ofstream out(file);
+    out << "PROGRAM BENCH\nVAR\n";
+    for (long long k = 0; k < distinct; k++)
+        out << (k % 8 ? "," : k ? " : INTEGER\n\t" : "\t") << identifier(k);
+    out << " : INTEGER\nBEGIN\n";
+
+    unsigned long long seed = 12345;
+    for (long long used = distinct; used < n; used += 3) {
+        long long a[3];
+        for (int j = 0; j < 3; j++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            a[j] = (seed >> 33) % distinct;
+        }
+        out << "\t" << identifier(a[0]) << " := " << identifier(a[1]) << " + " << identifier(a[2]) << " * " << seed % 1000 << ";\n";
+    }
+    out << "\tWRITE(" << identifier(0) << ")\nEND.\n";
+}
+
+/* Identifiers (^) and numbers (#) of a program in the order the lexer meets them */
+void scan(const char* file, vector<string>& names, vector<char>& types) {
+    static const char* keywords[] = {"PROGRAM", "VAR", "BEGIN", "END", "INTEGER", "FOR", "READ", "WRITE", "TO", "DO", "DIV"};
+    ifstream in(file);
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    for (size_t i = 0; i < text.length();) {
+        size_t j = i;
+        if (isalpha(text[i])) {
+            while (j < text.length() && isalnum(text[j]))
+                j++;
+            string word = text.substr(i, j - i);
+            bool keyword = false;
+            for (const char* k : keywords)
+                keyword |= word == k;
+            if (!keyword) {
+                names.push_back(word);
+                types.push_back('^');
+            }
+        } else if (isdigit(text[i])) {
+            while (j < text.length() && isdigit(text[j]))
+                j++;
+            names.push_back(text.substr(i, j - i));
+            types.push_back('#');
+        } else
+            j++;
+        i = j;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long long n = argc > 1 ? atoll(argv[1]) : 1000000;
+    long long distinct = argc > 2 ? atoll(argv[2]) : 20000;
+    if (n < 1 || distinct < 1 || distinct > n) {
+        cerr << "usage: " << argv[0] << " [identifiers] [distinct identifiers]" << endl;
+        return 1;
+    }
+
+    write_program("bench.pas", n, distinct);
+    vector<string> names;
+    vector<char> types;
+    scan("bench.pas", names, types);
+    cout << names.size() << " identifiers and numbers in bench.pas" << endl;
+
+    // install every name like install22()/install_num()
+    auto begin = chrono::steady_clock::now();
+    int chained_count = 0;
+    for (size_t i = 0; i < names.size(); i++) {
+        char* specifier = (char*)names[i].c_str();
+        if (chained_search(specifier) == nullptr) {
+            chained_insert(specifier, types[i]);
+            chained_count++;
+        }
+    }
+    double chained_time = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    // the lexer passes yytext and yyleng to install_symbol
+    begin = chrono::steady_clock::now();
+    init_symbol_table();
+    for (size_t i = 0; i < names.size(); i++)
+        install_symbol(names[i].c_str(), names[i].length(), types[i]);
+    double open_time = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    for (int i = 0; i < CHAINED_SIZE; i++)
+        for (chained_symbol* temp = CHAINED[i]; temp != nullptr; temp = temp->next) {
+            symbol* sym = search_symbol(temp->specifier);
+            if (sym == nullptr || sym->type != temp->type) {
+                cerr << "tables disagree on " << temp->specifier << endl;
+                return 1;
+            }
+        }
+    free_symbol_table();
+    cout << chained_count << " symbols" << endl;
+    cout << "chained, " << CHAINED_SIZE << " buckets: " << chained_time << " s" << endl;
+    cout << "open addressing:    " << open_time << " s (" << chained_time / open_time << "x)" << endl;
+    return 0;
+}
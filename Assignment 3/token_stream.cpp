@@ -0,0 +1,104 @@
+#include "token_stream.h"
+
+/* Write the collected bytes to the file */
+static void flush(token_writer* writer) {
+    if (writer->used && fwrite(writer->buffer, 1, writer->used, writer->file) != (size_t)writer->used) {
+        perror("token stream");
+        exit(1);
+    }
+    writer->used = 0;
+}
+
+/* Add bytes to the buffer, writing it out when it is full */
+static void put(token_writer* writer, const void* data, int length) {
+    if (writer->used + length > TOKEN_BUFFER)
+        flush(writer);
+    if (length > TOKEN_BUFFER) {
+        if (fwrite(data, 1, length, writer->file) != (size_t)length) {
+            perror("token stream");
+            exit(1);
+        }
+        return;
+    }
+    memcpy(writer->buffer + writer->used, data, length);
+    writer->used += length;
+}
+
+static void put_number(token_writer* writer, int number) {
+    char digits[12];
+    int length = snprintf(digits, sizeof(digits), "%d", number);
+    put(writer, digits, length);
+}
+
+/* Open the token file, writing the text heading or room for the binary header */
+bool open_token_writer(token_writer* writer, const char* name, bool binary) {
+    writer->file = fopen(name, binary ? "wb" : "w");
+    if (writer->file == nullptr)
+        return false;
+    writer->binary = binary;
+    writer->used = 0;
+    writer->tokens = 0;
+    writer->prev_line = 0;
+
+    if (binary) {
+        token_header header = {{'T', 'O', 'K', '1'}, 0, 0};
+        put(writer, &header, sizeof(header));
+    } else
+    {
+        const char* heading = "Line\tSymbol type\t\tSymbol Specifier\n";
+        put(writer, heading, strlen(heading));
+    }
+    return true;
+}
+
+/* Write one token, the text form leaves the line out while it does not change */
+void write_token(token_writer* writer, int token, int line, symbol* sym) {
+    writer->tokens++;
+    if (writer->binary) {
+        token_record record = {token, line, sym != nullptr ? sym->index : -1};
+        put(writer, &record, sizeof(record));
+        return;
+    }
+
+    // Print line number
+    if (line == writer->prev_line)
+        put(writer, " \t\t", 3);
+    else {
+        put_number(writer, line);
+        put(writer, "\t\t", 2);
+    }
+
+    // Print token id, type, and specifier
+    put(writer, "\t", 1);
+    put_number(writer, token);
+    if (sym != nullptr) {
+        put(writer, "\t\t\t", 3);
+        put(writer, &sym->type, 1);
+        put(writer, sym->specifier, sym->length);
+    }
+    put(writer, "\n", 1);
+    writer->prev_line = line;
+}
+
+/* Write what is left, then the symbols and the final header of a binary file */
+void close_token_writer(token_writer* writer) {
+    if (writer->binary) {
+        // one count for the loop and the header, so they agree if a symbol is added meanwhile
+        int count = symbol_count();
+        for (int i = 0; i < count; i++) {
+            symbol* sym = symbol_at(i);
+            token_symbol entry = {(uint32_t)sym->length, (uint32_t)sym->type};
+            static const char padding[4] = {0, 0, 0, 0};
+            put(writer, &entry, sizeof(entry));
+            put(writer, sym->specifier, sym->length);
+            put(writer, padding, (4 - sym->length % 4) % 4);
+        }
+        flush(writer);
+
+        token_header header = {{'T', 'O', 'K', '1'}, writer->tokens, (uint32_t)count};
+        fseek(writer->file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, writer->file);
+    } else
+        flush(writer);
+    fclose(writer->file);
+}
@@ -0,0 +1,45 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include <stdint.h>
+#include "symbol_table.h"
+
+#define TOKEN_BUFFER (1 << 16) /* bytes collected before a write */
+
+/* Binary token file: a header, one record per token, then the symbols by index.
+   Every part is a multiple of 4 bytes, so a parser can mmap the file and use the
+   records in place. */
+typedef struct token_header {
+    char magic[4];    /* "TOK1" */
+    uint32_t tokens;  /* number of token records */
+    uint32_t symbols; /* number of symbols after the records */
+} token_header;
+
+typedef struct token_record {
+    int32_t token;
+    int32_t line;
+    int32_t symbol; /* symbol index, -1 for tokens without a symbol */
+} token_record;
+
+/* A symbol after the records: its length, type and bytes padded to 4 */
+typedef struct token_symbol {
+    uint32_t length;
+    uint32_t type;
+} token_symbol;
+
+/* Define the token writer structure */
+typedef struct token_writer {
+    FILE* file;
+    bool binary;
+    char buffer[TOKEN_BUFFER];
+    int used;
+    uint32_t tokens;
+    int prev_line; /* line of the last text record */
+} token_writer;
+
+/* Function prototypes for token stream operations */
+bool open_token_writer(token_writer* writer, const char* name, bool binary);
+void write_token(token_writer* writer, int token, int line, symbol* sym);
+void close_token_writer(token_writer* writer);
+
+#endif /* TOKEN_STREAM_H */
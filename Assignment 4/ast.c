@@ -0,0 +1,340 @@
+/* header files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h" // Include the syntax tree header file for declarations
+
+ast_node *program_tree = NULL;
+int errors = 0;
+
+/* Nodes are taken from blocks of ARENA_NODES nodes, which free_ast releases together */
+#define ARENA_NODES 4096
+
+typedef struct arena_block
+{
+    struct arena_block *next;  // Block filled before this one
+    int used;                  // Nodes handed out from this block
+    ast_node nodes[ARENA_NODES];
+} arena_block;
+
+arena_block *arena = NULL;
+
+// Allocate a zeroed node on the current line
+ast_node *new_node(int kind)
+{
+    if (arena == NULL || arena->used == ARENA_NODES)
+    {
+        arena_block *block = (arena_block *)malloc(sizeof(arena_block));
+        if (block == NULL)
+        {
+            fprintf(stderr, "Out of memory for the syntax tree\n");
+            exit(1);
+        }
+        block->next = arena;
+        block->used = 0;
+        arena = block;
+    }
+    ast_node *node = &arena->nodes[arena->used++];
+    memset(node, 0, sizeof(ast_node));
+    node->kind = kind;
+    node->line = get_line_number();
+    return node;
+}
+
+// Start a list, first may be NULL for a statement that had a syntax error
+ast_node *new_list(ast_node *first)
+{
+    return append(new_node(AST_LIST), first);
+}
+
+// Add a node at the end of a list
+ast_node *append(ast_node *list, ast_node *node)
+{
+    if (node == NULL)
+        return list;
+    if (list->list.last)
+        list->list.last->next = node;
+    else
+        list->list.first = node;
+    list->list.last = node;
+    return list;
+}
+
+// Operator node
+ast_node *new_binary(int kind, ast_node *left, ast_node *right)
+{
+    ast_node *node = new_node(kind);
+    node->binary.left = left;
+    node->binary.right = right;
+    return node;
+}
+
+// Release every node
+void free_ast()
+{
+    while (arena != NULL)
+    {
+        arena_block *next = arena->next;
+        free(arena);
+        arena = next;
+    }
+    program_tree = NULL;
+}
+
+// Report an error found by a pass, in the format of yyerror
+void semantic_error(const char *message, int line)
+{
+    fprintf(stderr, "error: %s, line number: %d\n", message, line + 1);
+    errors++;
+}
+
+/* Semantic checks */
+
+// 0 for an INTEGER symbol, 1 for a REAL one
+int symbol_type(symbol *sym)
+{
+    return sym->type == 'F';
+}
+
+// Type of an expression; undeclared variables are integers and mixed operands give a real
+int check_expression(ast_node *node)
+{
+    static const char *mismatch[] = {"type mismatch on adding semantic error", "type mismatch on subtracting semantic error",
+                                     "type mismatch on multiplication semantic error", "type mismatch on division semantic error"};
+    switch (node->kind)
+    {
+    case AST_INT:
+        node->type = 0;
+        break;
+    case AST_REAL:
+        node->type = 1;
+        break;
+    case AST_VAR:
+        if (!node->sym->declared)
+        {
+            semantic_error("missing declaration semantic error", node->line);
+            node->type = 0;
+            break;
+        }
+        if (!node->sym->initialized)
+            semantic_error("variable not initialized semantic error", node->line);
+        node->type = symbol_type(node->sym);
+        break;
+    default:
+        node->type = check_expression(node->binary.left);
+        if (check_expression(node->binary.right) != node->type)
+        {
+            semantic_error(mismatch[node->kind - AST_ADD], node->line);
+            node->type = 1;
+        }
+    }
+    return node->type;
+}
+
+// A value of the given type is stored in sym
+void check_assignment(symbol *sym, int type, int line)
+{
+    if (!sym->declared)
+        semantic_error("missing declaration semantic error", line);
+    else if (type != symbol_type(sym))
+        semantic_error("type mismatch on assignment semantic error", line); // the variable stays uninitialized
+    else
+        sym->initialized = 1;
+}
+
+// A READ or WRITE list names every variable once
+void check_duplicates(ast_node *vars)
+{
+    for (ast_node *var = vars->list.first; var != NULL; var = var->next)
+        for (ast_node *other = vars->list.first; other != var; other = other->next)
+            if (other->sym == var->sym)
+            {
+                semantic_error("duplicate symbol semantic error", var->line);
+                break;
+            }
+}
+
+// Check a statement or a list of statements in program order
+void check_statement(ast_node *node)
+{
+    switch (node->kind)
+    {
+    case AST_LIST:
+        for (ast_node *stmt = node->list.first; stmt != NULL; stmt = stmt->next)
+            check_statement(stmt);
+        break;
+    case AST_DECL:
+        // the first declaration of a variable wins
+        for (ast_node *var = node->decl.vars->list.first; var != NULL; var = var->next)
+        {
+            if (var->sym->declared)
+                semantic_error("duplicate symbol semantic error", var->line);
+            else
+            {
+                var->sym->type = node->type ? 'F' : 'I';
+                var->sym->declared = 1;
+            }
+        }
+        break;
+    case AST_READ:
+        check_duplicates(node->decl.vars);
+        for (ast_node *var = node->decl.vars->list.first; var != NULL; var = var->next)
+        {
+            if (!var->sym->declared)
+                semantic_error("missing declaration semantic error", var->line);
+            else
+                var->sym->initialized = 1;
+            var->type = symbol_type(var->sym);
+        }
+        break;
+    case AST_WRITE:
+        check_duplicates(node->decl.vars);
+        for (ast_node *var = node->decl.vars->list.first; var != NULL; var = var->next)
+            check_expression(var);
+        break;
+    case AST_ASSIGN:
+        check_assignment(node->assign.sym, check_expression(node->assign.value), node->line);
+        break;
+    case AST_FOR:
+        node->type = check_expression(node->loop.from);
+        if (check_expression(node->loop.to) != node->type)
+            semantic_error("type mismatch on assignment semantic error", node->line);
+        check_assignment(node->loop.sym, node->type, node->line);
+        check_statement(node->loop.body);
+        break;
+    }
+}
+
+// Semantic checks over the whole program, returns the number of errors so far
+int check_program(ast_node *program)
+{
+    check_statement(program->program.decls);
+    check_statement(program->program.body);
+    return errors;
+}
+
+/* Evaluation, only of programs without errors, so every node has the type of its operands */
+
+void runtime_error(const char *message, int line)
+{
+    fflush(stdout);
+    fprintf(stderr, "error: %s runtime error, line number: %d\n", message, line + 1);
+    exit(1);
+}
+
+// Integer expressions wrap around on overflow instead of trapping
+int eval_int(ast_node *node)
+{
+    switch (node->kind)
+    {
+    case AST_INT:
+        return node->integer;
+    case AST_VAR:
+        return node->sym->integer;
+    case AST_ADD:
+        return (int)((unsigned)eval_int(node->binary.left) + (unsigned)eval_int(node->binary.right));
+    case AST_SUB:
+        return (int)((unsigned)eval_int(node->binary.left) - (unsigned)eval_int(node->binary.right));
+    case AST_MUL:
+        return (int)((unsigned)eval_int(node->binary.left) * (unsigned)eval_int(node->binary.right));
+    case AST_DIV:
+    {
+        int left = eval_int(node->binary.left);
+        int right = eval_int(node->binary.right);
+        if (right == 0)
+            runtime_error("division by zero", node->line);
+        if (right == -1)
+            return (int)(0u - (unsigned)left);
+        return left / right;
+    }
+    }
+    return 0;
+}
+
+float eval_real(ast_node *node)
+{
+    switch (node->kind)
+    {
+    case AST_REAL:
+        return node->real;
+    case AST_VAR:
+        return node->sym->real;
+    case AST_ADD:
+        return eval_real(node->binary.left) + eval_real(node->binary.right);
+    case AST_SUB:
+        return eval_real(node->binary.left) - eval_real(node->binary.right);
+    case AST_MUL:
+        return eval_real(node->binary.left) * eval_real(node->binary.right);
+    case AST_DIV:
+    {
+        float left = eval_real(node->binary.left);
+        float right = eval_real(node->binary.right);
+        if (right == 0)
+            runtime_error("division by zero", node->line);
+        return left / right;
+    }
+    }
+    return 0;
+}
+
+void run_statement(ast_node *node)
+{
+    switch (node->kind)
+    {
+    case AST_LIST:
+        for (ast_node *stmt = node->list.first; stmt != NULL; stmt = stmt->next)
+            run_statement(stmt);
+        break;
+    case AST_ASSIGN:
+        if (node->assign.value->type == 0)
+            node->assign.sym->integer = eval_int(node->assign.value);
+        else
+            node->assign.sym->real = eval_real(node->assign.value);
+        break;
+    case AST_READ:
+        for (ast_node *var = node->decl.vars->list.first; var != NULL; var = var->next)
+            if (var->type == 0 ? scanf("%d", &var->sym->integer) != 1 : scanf("%f", &var->sym->real) != 1)
+                runtime_error("missing input for READ", node->line);
+        break;
+    case AST_WRITE:
+        for (ast_node *var = node->decl.vars->list.first; var != NULL; var = var->next)
+        {
+            if (var->type == 0)
+                printf("%s%d", var == node->decl.vars->list.first ? "" : " ", var->sym->integer);
+            else
+                printf("%s%g", var == node->decl.vars->list.first ? "" : " ", var->sym->real);
+        }
+        printf("\n");
+        break;
+    case AST_FOR:
+        // the bounds are evaluated once and the loop runs while the index is at most the upper bound
+        if (node->type == 0)
+        {
+            int from = eval_int(node->loop.from);
+            int to = eval_int(node->loop.to);
+            for (long long i = from; i <= to; i++)
+            {
+                node->loop.sym->integer = (int)i;
+                run_statement(node->loop.body);
+            }
+        }
+        else
+        {
+            double from = eval_real(node->loop.from);
+            double to = eval_real(node->loop.to);
+            for (long long i = 0; from + i <= to; i++)
+            {
+                node->loop.sym->real = (float)(from + i);
+                run_statement(node->loop.body);
+            }
+        }
+        break;
+    }
+}
+
+// Execute a checked program, READ takes numbers from stdin and WRITE prints a line
+void run_program(ast_node *program)
+{
+    run_statement(program->program.body);
+    fflush(stdout);
+}
@@ -0,0 +1,68 @@
+#ifndef AST_H
+#define AST_H
+
+/* header files */
+#include "symbol_table.h"
+
+/*
+ * Syntax tree built by parser.y. The parser only builds the tree; check_program
+ * finds the semantic errors and run_program executes a checked program, so a
+ * program can be checked once and run any number of times.
+ *
+ * Nodes are allocated from an arena and released together by free_ast.
+ * Variables point to their symbols, which the lexer resolved, so no pass looks
+ * a name up again.
+ */
+
+typedef enum ast_kind
+{
+    AST_PROGRAM,               // declarations and statements
+    AST_LIST,                  // nodes linked by next
+    AST_DECL,                  // variables declared with one type
+    AST_ASSIGN,                // variable := expression
+    AST_READ,                  // READ(variables)
+    AST_WRITE,                 // WRITE(variables)
+    AST_FOR,                   // FOR variable := from TO to DO body
+    AST_ADD,                   // left + right
+    AST_SUB,                   // left - right
+    AST_MUL,                   // left * right
+    AST_DIV,                   // left DIV right
+    AST_INT,                   // integer literal
+    AST_REAL,                  // real literal
+    AST_VAR                    // variable in an expression or a list
+} ast_kind;
+
+typedef struct ast_node
+{
+    unsigned char kind;        // ast_kind
+    signed char type;          // 0 integer, 1 real, set by check_program (declared type for AST_DECL)
+    int line;                  // line number for error messages
+    struct ast_node *next;     // next node of an AST_LIST
+    union
+    {
+        int integer;                                                            // AST_INT
+        float real;                                                             // AST_REAL
+        symbol *sym;                                                            // AST_VAR
+        struct { struct ast_node *first, *last; } list;                         // AST_LIST
+        struct { struct ast_node *decls, *body; } program;                      // AST_PROGRAM
+        struct { struct ast_node *vars; } decl;                                 // AST_DECL, AST_READ, AST_WRITE
+        struct { symbol *sym; struct ast_node *value; } assign;                 // AST_ASSIGN
+        struct { symbol *sym; struct ast_node *from, *to, *body; } loop;        // AST_FOR
+        struct { struct ast_node *left, *right; } binary;                       // AST_ADD .. AST_DIV
+    };
+} ast_node;
+
+extern ast_node *program_tree; // Tree of the last program parsed
+extern int errors;             // Number of syntax and semantic errors reported
+
+/* Function prototypes */
+ast_node *new_node(int kind);                                        // Allocate a node on the current line
+ast_node *new_list(ast_node *first);                                 // Start a list with one node
+ast_node *append(ast_node *list, ast_node *node);                    // Add a node at the end of a list
+ast_node *new_binary(int kind, ast_node *left, ast_node *right);     // Operator node
+void semantic_error(const char *message, int line);                  // Report an error found by a pass
+int check_program(ast_node *program);                                // Semantic checks, returns the number of errors
+void run_program(ast_node *program);                                 // Execute a checked program
+void free_ast();                                                     // Release every node
+
+#endif /* AST_H */
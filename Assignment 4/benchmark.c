@@ -0,0 +1,263 @@
+/* header files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "ast.h" // Include the syntax tree header file for declarations
+
+/*
+ * Throughput benchmark of the scanner and the parser. Every input file is run
+ * through three stages:
+ *
+ *   scan         yylex() alone, identifiers are not installed
+ *   scan+symtab  yylex() with install_id() as the parser runs it
+ *   parse        yyparse() and check_program(), the whole front end
+ *
+ *   lex lexer.l
+ *   yacc -d parser.y
+ *   cc -O2 -DBENCHMARK lex.yy.c y.tab.c ast.c benchmark.c -o benchmark
+ *   ./benchmark [-r repeats] [-json] file...
+ *
+ * Every run is a child process, so it starts with an empty symbol table and its
+ * peak resident memory (ru_maxrss) is its own. The text is read into memory
+ * first and handed to flex with yy_scan_bytes, so disk reads are not timed.
+ * The best time of the repeats is reported.
+ */
+
+/* flex and bison functions */
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+YY_BUFFER_STATE yy_scan_bytes(const char *bytes, int len);
+void yy_delete_buffer(YY_BUFFER_STATE buffer);
+int yylex(void);
+int yyparse(void);
+extern int install_symbols;
+
+#define STAGES 3
+const char *stage_names[STAGES] = {"scan", "scan+symtab", "parse"};
+
+typedef struct result
+{
+    double seconds;            // best time of the repeats
+    long tokens;               // tokens returned by yylex, 0 for the parse stage
+    long peak_kb;              // largest peak resident memory of the repeats
+    int failed;                // a run did not exit normally
+} result;
+
+double now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Run a stage once in this process and time it
+void run_stage(int stage, const char *text, int length, double *seconds, long *tokens)
+{
+    init();
+    line = 0;
+    install_symbols = stage != 0;
+    YY_BUFFER_STATE buffer = yy_scan_bytes(text, length);
+
+    double start = now();
+    *tokens = 0;
+    if (stage == 2)
+    {
+        yyparse();
+        if (program_tree != NULL)
+            check_program(program_tree);
+    }
+    else
+        while (yylex())
+            (*tokens)++;
+    *seconds = now() - start;
+
+    yy_delete_buffer(buffer);
+}
+
+// Run a stage in a child process, returns 0 if the child did not finish
+int measure(int stage, const char *text, int length, double *seconds, long *tokens, long *peak_kb)
+{
+    int fd[2];
+    if (pipe(fd))
+    {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0)
+    {
+        // the parser prints the symbol table, keep it out of the report
+        close(fd[0]);
+        if (freopen("/dev/null", "w", stdout) == NULL)
+            _exit(1);
+        double values[2];
+        long count;
+        run_stage(stage, text, length, &values[0], &count);
+        values[1] = count;
+        if (write(fd[1], values, sizeof(values)) != sizeof(values))
+            _exit(1);
+        _exit(0);
+    }
+
+    close(fd[1]);
+    double values[2];
+    int received = read(fd[0], values, sizeof(values)) == sizeof(values);
+    close(fd[0]);
+
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    if (!received || !WIFEXITED(status) || WEXITSTATUS(status))
+        return 0;
+    *seconds = values[0];
+    *tokens = (long)values[1];
+    *peak_kb = usage.ru_maxrss;
+    return 1;
+}
+
+// Read a whole file into memory
+char *read_file(const char *file, long *length)
+{
+    FILE *fp = fopen(file, "rb");
+    if (fp == NULL)
+    {
+        perror(file);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    *length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *text = (char *)malloc(*length + 1);
+    if (text == NULL || fread(text, 1, *length, fp) != (size_t)*length)
+    {
+        perror(file);
+        exit(1);
+    }
+    fclose(fp);
+    return text;
+}
+
+// Print a string as a JSON string literal
+void json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+int main(int argc, char *argv[])
+{
+    int repeats = 5, json = 0, files = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            repeats = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-json"))
+            json = 1;
+        else
+            argv[1 + files++] = argv[i];
+    }
+    if (files == 0)
+    {
+        fprintf(stderr, "usage: %s [-r repeats] [-json] file...\n", argv[0]);
+        return 1;
+    }
+    if (repeats < 1)
+        repeats = 1;
+
+    int failures = 0;
+    if (json)
+        printf("[\n");
+    for (int f = 1; f <= files; f++)
+    {
+        long length;
+        char *text = read_file(argv[f], &length);
+        long lines = 0;
+        for (long i = 0; i < length; i++)
+            lines += text[i] == '\n';
+        if (length > 0 && text[length - 1] != '\n')
+            lines++;
+
+        result results[STAGES];
+        for (int s = 0; s < STAGES; s++)
+        {
+            result *r = &results[s];
+            r->seconds = -1;
+            r->tokens = 0;
+            r->peak_kb = 0;
+            r->failed = 0;
+            for (int k = 0; k < repeats && !r->failed; k++)
+            {
+                double seconds;
+                long tokens, peak_kb;
+                if (!measure(s, text, length, &seconds, &tokens, &peak_kb))
+                {
+                    r->failed = 1;
+                    failures++;
+                    break;
+                }
+                if (r->seconds < 0 || seconds < r->seconds)
+                    r->seconds = seconds;
+                if (peak_kb > r->peak_kb)
+                    r->peak_kb = peak_kb;
+                r->tokens = tokens;
+            }
+        }
+        // the parser scans the same tokens as the scanner
+        long tokens = results[0].tokens;
+
+        if (json)
+        {
+            printf("  {\"file\": ");
+            json_string(argv[f]);
+            printf(", \"bytes\": %ld, \"lines\": %ld, \"tokens\": %ld, \"repeats\": %d, \"stages\": {", length, lines, tokens, repeats);
+            for (int s = 0; s < STAGES; s++)
+            {
+                result *r = &results[s];
+                printf("%s\n    \"%s\": ", s ? "," : "", stage_names[s]);
+                if (r->failed)
+                    printf("null");
+                else
+                    printf("{\"seconds\": %.6f, \"tokens_per_second\": %.0f, \"lines_per_second\": %.0f, \"peak_kb\": %ld}",
+                           r->seconds, r->seconds > 0 ? tokens / r->seconds : 0, r->seconds > 0 ? lines / r->seconds : 0, r->peak_kb);
+            }
+            printf("}}%s\n", f < files ? "," : "");
+        }
+        else
+        {
+            printf("%s: %ld bytes, %ld lines, %ld tokens\n", argv[f], length, lines, tokens);
+            for (int s = 0; s < STAGES; s++)
+            {
+                result *r = &results[s];
+                if (r->failed)
+                {
+                    printf("  %-12s failed\n", stage_names[s]);
+                    continue;
+                }
+                printf("  %-12s %10.6f s %8.2f M tokens/s %8.2f M lines/s  peak %ld KB\n", stage_names[s], r->seconds,
+                       r->seconds > 0 ? tokens / r->seconds / 1e6 : 0, r->seconds > 0 ? lines / r->seconds / 1e6 : 0, r->peak_kb);
+            }
+        }
+        free(text);
+    }
+    if (json)
+        printf("]\n");
+    return failures != 0;
+}
@@ -0,0 +1,8 @@
+lex lexer.l
+yacc -d parser.y
+cc -O2 -DBENCHMARK lex.yy.c y.tab.c ast.c benchmark.c -o benchmark
+cc -O2 generate_program.c -o generate_program
+./generate_program -ids 100 -stmts 10000 -o bench_small.pas
+./generate_program -ids 1000 -stmts 100000 -depth 4 -o bench_medium.pas
+./generate_program -ids 200 -stmts 1000000 -o bench_large.pas
+./benchmark -json bench_small.pas bench_medium.pas bench_large.pas > benchmark.json
@@ -0,0 +1,235 @@
+/* header files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Generator of benchmark inputs for the parser: writes a program in the
+ * PROGRAM/VAR/BEGIN/FOR/READ/WRITE language that parses without syntax or
+ * semantic errors.
+ *
+ *   cc -O2 generate_program.c -o generate_program
+ *   ./generate_program [-ids N] [-stmts N] [-depth N] [-reals PERCENT] [-loops N] [-seed N] [-o file]
+ *
+ * Integer variables are named I<n> and real variables R<n>, so no name is a
+ * keyword. Every variable is declared, read before the first statement and only
+ * used in expressions of its own type. DIV only divides by literals from 1 to 9,
+ * and FOR loops run from 1 to a literal of at most -loops, so the programs can be
+ * run as well as parsed.
+ */
+
+int ids = 100;          // number of declared variables
+int stmts = 1000;       // number of statements after the initial READs
+int depth = 3;          // deepest nesting of parenthesized subexpressions
+int reals = 25;         // percentage of REAL variables
+int loops = 10;         // largest upper bound of a FOR loop
+unsigned long long seed = 1;
+
+int integers;           // variables I0 .. I(integers - 1), the rest are R0 ..
+int written = 0;        // statements written so far
+FILE *out;
+
+// 64-bit LCG, random number in [0, n)
+int random_below(int n)
+{
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (int)((seed >> 33) % (unsigned long long)n);
+}
+
+// Write a random variable of the given type (0 integer, 1 real)
+void variable(int type)
+{
+    if (type == 0)
+        fprintf(out, "I%d", random_below(integers));
+    else
+        fprintf(out, "R%d", random_below(ids - integers));
+}
+
+// Write a literal of the given type
+void literal(int type)
+{
+    if (type == 0)
+        fprintf(out, "%d", random_below(100));
+    else
+        fprintf(out, "%d.%d", random_below(100), random_below(10));
+}
+
+// Write an expression of the given type with at most levels of parentheses
+void expression(int type, int levels)
+{
+    int terms = 1 + random_below(3);
+    for (int i = 0; i < terms; i++)
+    {
+        if (i > 0)
+        {
+            int op = random_below(type == 0 ? 4 : 3);
+            if (op == 3)
+            {
+                // divide by a literal so running the program never divides by zero
+                fprintf(out, " DIV %d", 1 + random_below(9));
+                continue;
+            }
+            fprintf(out, " %c ", "+-*"[op]);
+        }
+
+        int kind = random_below(4);
+        if (kind == 0 && levels > 0)
+        {
+            fprintf(out, "(");
+            expression(type, levels - 1);
+            fprintf(out, ")");
+        }
+        else if (kind == 1)
+            literal(type);
+        else
+            variable(type);
+    }
+}
+
+// Write a list of 1 to 4 distinct variables, as READ and WRITE take them
+void variable_list()
+{
+    int count = 1 + random_below(4);
+    if (count > ids)
+        count = ids;
+    int first = random_below(ids);
+    for (int i = 0; i < count; i++)
+    {
+        int k = (first + i) % ids;
+        if (k < integers)
+            fprintf(out, "%sI%d", i ? ", " : "", k);
+        else
+            fprintf(out, "%sR%d", i ? ", " : "", k - integers);
+    }
+}
+
+void indent(int level)
+{
+    for (int i = 0; i < level; i++)
+        fputc('\t', out);
+}
+
+// Write one statement, FOR loops take statements for their bodies from the budget
+void statement(int level)
+{
+    written++;
+    int kind = random_below(20);
+    indent(level);
+    if (kind < 2 && level < 4 && integers > 0 && stmts - written > 1)
+    {
+        fprintf(out, "FOR I%d := 1 TO %d DO\n", random_below(integers), 1 + random_below(loops));
+        int body = 1 + random_below(4);
+        if (body > stmts - written)
+            body = stmts - written;
+        if (body == 1)
+        {
+            statement(level + 1);
+            return;
+        }
+        indent(level);
+        fprintf(out, "BEGIN\n");
+        for (int i = 0; i < body; i++)
+        {
+            statement(level + 1);
+            fprintf(out, i + 1 < body ? ";\n" : "\n");
+        }
+        indent(level);
+        fprintf(out, "END");
+    }
+    else if (kind < 4)
+    {
+        fprintf(out, kind == 2 ? "READ(" : "WRITE(");
+        variable_list();
+        fprintf(out, ")");
+    }
+    else
+    {
+        int type = random_below(ids) < integers ? 0 : 1;
+        variable(type);
+        fprintf(out, " := ");
+        expression(type, depth);
+    }
+}
+
+// Declare variables <prefix>0 .. <prefix>(count - 1), the last declaration has no semicolon
+void declare(char prefix, int count, const char *type, int last)
+{
+    for (int k = 0; k < count; k += 8)
+    {
+        fprintf(out, "\t");
+        for (int j = k; j < count && j < k + 8; j++)
+            fprintf(out, "%s%c%d", j > k ? "," : "", prefix, j);
+        fprintf(out, " : %s%s\n", type, last && k + 8 >= count ? "" : ";");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    char *output = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && !strcmp(argv[i], "-ids"))
+            ids = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-stmts"))
+            stmts = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-depth"))
+            depth = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-reals"))
+            reals = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-loops"))
+            loops = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-seed"))
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (i + 1 < argc && !strcmp(argv[i], "-o"))
+            output = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [-ids N] [-stmts N] [-depth N] [-reals PERCENT] [-loops N] [-seed N] [-o file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ids < 1)
+        ids = 1;
+    if (stmts < 1)
+        stmts = 1;
+    if (reals < 0 || reals > 100)
+        reals = 25;
+    if (loops < 1)
+        loops = 1;
+    integers = ids - ids * reals / 100;
+    if (integers == 0 && ids > 1)
+        integers = 1; // FOR loops need an integer index
+
+    out = output ? fopen(output, "w") : stdout;
+    if (out == NULL)
+    {
+        perror(output);
+        return 1;
+    }
+
+    // declarations, eight names per line
+    fprintf(out, "PROGRAM BENCH\nVAR\n");
+    declare('I', integers, "INTEGER", integers == ids);
+    declare('R', ids - integers, "REAL", 1);
+
+    // every variable is read before it is used
+    fprintf(out, "BEGIN\n");
+    for (int k = 0; k < ids; k += 8)
+    {
+        fprintf(out, "\tREAD(");
+        for (int j = k; j < ids && j < k + 8; j++)
+            fprintf(out, j < integers ? "%sI%d" : "%sR%d", j > k ? ", " : "", j < integers ? j : j - integers);
+        fprintf(out, ");\n");
+    }
+
+    while (written < stmts)
+    {
+        statement(1);
+        fprintf(out, written < stmts ? ";\n" : "\n");
+    }
+    fprintf(out, "END.\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,24 @@
+PROGRAM NUMERIC
+VAR
+	I,J,N,M,SUM,T : INTEGER;
+	X,STEP,AREA : REAL
+BEGIN
+	READ(N, M);
+	SUM := 0;
+	FOR I := 1 TO N DO
+		FOR J := 1 TO M DO
+		BEGIN
+			T := (I * J + 7) DIV 3;
+			SUM := SUM + T - J * 2
+		END;
+	AREA := 0.0;
+	X := 0.0;
+	STEP := 0.001;
+	FOR I := 1 TO N DO
+		FOR J := 1 TO M DO
+		BEGIN
+			X := STEP * 0.5 + X;
+			AREA := AREA + X * STEP
+		END;
+	WRITE(SUM, AREA)
+END.
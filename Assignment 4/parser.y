@@ -2,7 +2,8 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
-#define NOT_INIT -10000000
+#include "ast.h"
+#include "vm.h"
 #define YYERROR_VERBOSE 
 
 
@@ -10,30 +11,13 @@
 int yylex(void);
 int yyparse(void);
 
-void init();
-
-int get_int_value(char*);
-float get_real_value(char*);
-void set_int_value(char*, int);
-void set_real_value(char*, float);
-int get_type(char*);
-int set_type(int);
-int set_init();
-void clear_list();
-
-int is_initialized(char*);
-int is_declared(char*);
-
-int add_id(char*);
-void print_id_list(void);
-void print_hash_table(void);
-
-int get_line_number(void);
+extern FILE *yyin;
 
 /* error handling */
 void yyerror(const char *str)
 {
         fprintf(stderr,"error: %s, line number: %d\n",str, get_line_number() + 1);
+        errors++;
 }
 
 int yywrap()
@@ -41,11 +25,47 @@ int yywrap()
         return 1;
 }
 
-int main()
+/* benchmark.c has its own main */
+#ifndef BENCHMARK
+/* ./a.out [-run | -tree] [program.pas]: parse, check and print the symbol table;
+   with -run a program without errors is then compiled to bytecode and executed,
+   reading numbers from stdin; -tree executes it with the tree evaluator instead */
+int main(int argc, char *argv[])
 {
+	int run = 0, tree = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-run"))
+			run = 1;
+		else if (!strcmp(argv[i], "-tree"))
+			run = tree = 1;
+		else if ((yyin = fopen(argv[i], "r")) == NULL) {
+			perror(argv[i]);
+			exit(1);
+		}
+	}
+
 	init();
         yyparse();
+	if (program_tree == NULL)
+		return 1;
+
+	check_program(program_tree);
+	print_hash_table();
+	if (run) {
+		if (errors)
+			fprintf(stderr, "%d errors, the program is not run\n", errors);
+		else if (tree)
+			run_program(program_tree);
+		else {
+			bytecode *code = compile_program(program_tree);
+			run_bytecode(code);
+			free_bytecode(code);
+		}
+	}
+	free_ast();
+	return errors != 0;
 }
+#endif
 
 
 %}
@@ -82,234 +102,131 @@ int main()
 			int integer;
 		};
 	}NUMBER;
-	char* ID;
+	struct symbol* ID;
+	struct ast_node* NODE;
 }
 
 %token <NUMBER>  _FLOAT
 %token <ID> _ID	
 %token <NUMBER> _INT
-%type <NUMBER> exp factor term
+%type <NODE> declist dec type idlist stmtlist stmt assign read write for indexexp body exp term factor
 
 %left _ADD _SUB 
 %left _MUL _DIV 
 
 %%
-program: _PROGRAM progname _VAR declist _BEGIN stmtlist _END_DOT { print_hash_table(); }
+program: _PROGRAM progname _VAR declist _BEGIN stmtlist _END_DOT { 
+		program_tree = new_node(AST_PROGRAM);
+		program_tree->program.decls = $4;
+		program_tree->program.body = $6;
+	}
        ;
 
 progname: _ID
 	;
 
-declist: dec
-       | declist _SEMICOLON dec
+declist: dec { $$ = new_list($1); }
+       | declist _SEMICOLON dec { $$ = append($1, $3); }
        ;
 
-dec: idlist _COLON type 
+dec: idlist _COLON type { 
+   		$$ = $3;
+		$$->decl.vars = $1;
+	}
    ;
 
 type: _INTEGER { 
-    		if(!set_type(0)) 
-    			yyerror("duplicate symbol semantic error");
+    		$$ = new_node(AST_DECL);
+		$$->type = 0;
 	}
     | _REAL { 
-    		if(!set_type(1))
-    			yyerror("duplicate symbol semantic error");
+    		$$ = new_node(AST_DECL);
+		$$->type = 1;
 	}
     ;
 
 idlist: _ID { 
-      		if(!add_id($1))
-      			yyerror("duplicate symbol semantic error");
-
+      		ast_node *var = new_node(AST_VAR);
+		var->sym = $1;
+		$$ = new_list(var);
 	}
       | idlist _COMMA _ID { 
-      		if(!add_id($3))
-      			yyerror("duplicate symbol semantic error");
+      		ast_node *var = new_node(AST_VAR);
+		var->sym = $3;
+		$$ = append($1, var);
 	} 
       ;
 
-stmtlist: stmt
-	| stmtlist _SEMICOLON stmt
+stmtlist: stmt { $$ = new_list($1); }
+	| stmtlist _SEMICOLON stmt { $$ = append($1, $3); }
 	;
 
 stmt: assign 
     | read
     | write
     | for
-    | error 
+    | error { $$ = NULL; }
     ;
 
 assign: _ID _ASSIGN exp { 
-      		if(is_declared($1)) {
-			if($3.type == get_type($1)) {
-				if($3.type == 0) 
-					set_int_value($1, $3.integer); 
-				else if($3.type == 1)
-					set_real_value($1, $3.real);
-			}
-			else 
-				yyerror("type mismatch on assignment semantic error");// expression assignment mismatch
-		}
-		else
-			yyerror("missing declaration semantic error");// error not declared symbol
+      		$$ = new_node(AST_ASSIGN);
+		$$->assign.sym = $1;
+		$$->assign.value = $3;
 	}
       ;
 
-exp: exp _ADD term {
-    		if($1.type == $3.type) {
-			if($1.type == 0) {
-    				$$.integer = $1.integer + $3.integer; 
-				$$.type = 0;
-			}
-			if($1.type == 1) {
-				$$.real = $1.real + $3.real; 
-				$$.type = 1;
-			}
-		}
-		else {
-			yyerror("type mismatch on adding semantic error");
-			$$.type = 1;
-			if($1.type == 0)
-				$$.real = $1.integer + $3.real;
-			else
-				$$.real = $1.real + $3.integer;
-		}
-   } 
-   | exp _SUB term {
-    		if($1.type == $3.type) {
-			if($1.type == 0) {
-    				$$.integer = $1.integer - $3.integer; 
-				$$.type = 0;
-			}
-			if($1.type == 1) {
-				$$.real = $1.real - $3.real; 
-				$$.type = 1;
-			}
-		}
-		else {
-			yyerror("type mismatch on subtracting semantic error");
-			$$.type = 1;
-			if($1.type == 0)
-				$$.real = $1.integer - $3.real;
-			else
-				$$.real = $1.real - $3.integer;
-		}
-   }  
+exp: exp _ADD term { $$ = new_binary(AST_ADD, $1, $3); }
+   | exp _SUB term { $$ = new_binary(AST_SUB, $1, $3); }
    | term
    ;
 
-term: term _MUL factor {
-    		if($1.type == $3.type) {
-			if($1.type == 0) {
-    				$$.integer = $1.integer * $3.integer; 
-				$$.type = 0;
-			}
-			if($1.type == 1) {
-				$$.real = $1.real * $3.real; 
-				$$.type = 1;
-			}
-		}
-		else {
-			yyerror("type mismatch on multiplication semantic error");
-			$$.type = 1;
-			if($1.type == 0)
-				$$.real = $1.integer * $3.real;
-			else
-				$$.real = $1.real * $3.integer;
-		}
-    }
-    | term _DIV factor { 
-    		if($1.type == $3.type) {
-			if($1.type == 0) {
-    				$$.integer = $1.integer / $3.integer; 
-				$$.type = 0;
-			}
-			if($1.type == 1) {
-				$$.real = $1.real / $3.real; 
-				$$.type = 1;
-			}
-		}
-		else {
-			yyerror("type mismatch on division semantic error");
-			$$.type = 1;
-			if($1.type == 0)
-				$$.real = $1.integer / $3.real;
-			else
-				$$.real = $1.real / $3.integer;
-		}
-	}
+term: term _MUL factor { $$ = new_binary(AST_MUL, $1, $3); }
+    | term _DIV factor { $$ = new_binary(AST_DIV, $1, $3); }
     | factor
     ;
 
 factor: _OPEN_BRACE exp _CLOSE_BRACE { $$ = $2; }
-      | _INT { $$ = $1; }
+      | _INT { 
+      		$$ = new_node(AST_INT);
+		$$->integer = $1.integer;
+	}
       | _ID { 
-      		if(is_declared($1)) {
-			if(is_initialized($1)) {
-				if(get_type($1) == 0) {
-					$$.integer = get_int_value($1); 
-					$$.type = 0;
-				}
-				if(get_type($1) == 1) {
-					$$.real = get_real_value($1); 
-					$$.type = 1;
-				}
-			}
-			else {
-				yyerror("variable not initialized semantic error");
-
-				// not initialized so initialize to default values
-				$$.integer = NOT_INIT; 
-				$$.type = get_type($1);
-			}
-		}
-		else {
-			yyerror("missing declaration semantic error"); 
-
-			// not declared so initialize to default values and give integer type
-			$$.integer = NOT_INIT; 
-			$$.type = 0;
-		}
+      		$$ = new_node(AST_VAR);
+		$$->sym = $1;
+	}
+      | _FLOAT { 
+      		$$ = new_node(AST_REAL);
+		$$->real = $1.real;
 	}
-      | _FLOAT { $$ = $1; }
       ;
 
 read: _READ _OPEN_BRACE idlist _CLOSE_BRACE {
-	if(!set_init())
-		yyerror("missing declaration semantic error");
-
+	$$ = new_node(AST_READ);
+	$$->decl.vars = $3;
     }
     ;
 
 write: _WRITE _OPEN_BRACE idlist _CLOSE_BRACE {
-     	clear_list();
+     	$$ = new_node(AST_WRITE);
+	$$->decl.vars = $3;
      }
      ;
 
-for: _FOR indexexp _DO body
+for: _FOR indexexp _DO body {
+   	$$ = $2;
+	$$->loop.body = $4;
+   }
    ;
 
 indexexp: _ID _ASSIGN exp _TO exp {
-		if($3.type != $5.type) {
-			yyerror("type mismatch on assignment semantic error");
-		}
-      		if(is_declared($1)) {
-			if($3.type == get_type($1)) {
-				if($3.type == 0) 
-					set_int_value($1, $3.integer); 
-				else if($3.type == 1)
-					set_real_value($1, $3.real);
-			}
-			else 
-				yyerror("type mismatch on assignment semantic error");// expression assignment mismatch
-		}
-		else
-			yyerror("missing declaration semantic error");// error not declared symbol
-		
+		$$ = new_node(AST_FOR);
+		$$->loop.sym = $1;
+		$$->loop.from = $3;
+		$$->loop.to = $5;
 	}
 	;
 
-body: _BEGIN stmtlist _END
-    | stmt
+body: _BEGIN stmtlist _END { $$ = $2; }
+    | stmt { $$ = new_list($1); }
     ;
 %%
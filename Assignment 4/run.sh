@@ -1,3 +1,3 @@
 lex lexer.l
 yacc -d parser.y
-cc lex.yy.c y.tab.c
+cc -O2 lex.yy.c y.tab.c ast.c vm.c
@@ -0,0 +1,488 @@
+/* header files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h" // Include the bytecode header file for declarations
+
+#if defined(__GNUC__) && !defined(VM_SWITCH)
+#define THREADED
+#endif
+
+/* Compiler */
+
+int temps_used;                // Temporaries in use while compiling
+int *constant_table;           // Hash of literal bits to constant index + 1
+int constant_table_size;
+
+void *grow_array(void *array, int *capacity, int size)
+{
+    *capacity = *capacity ? 2 * *capacity : 256;
+    array = realloc(array, (size_t)*capacity * size);
+    if (array == NULL)
+    {
+        fprintf(stderr, "Out of memory for the bytecode\n");
+        exit(1);
+    }
+    return array;
+}
+
+// Append an instruction, returns its address
+int emit(bytecode *p, int op, int a, int b, int c, int line)
+{
+    if (p->length == p->capacity)
+    {
+        int capacity = p->capacity;
+        p->code = (instruction *)grow_array(p->code, &p->capacity, sizeof(instruction));
+        p->lines = (int *)grow_array(p->lines, &capacity, sizeof(int));
+    }
+    instruction *ins = &p->code[p->length];
+    ins->op = op;
+    ins->a = a;
+    ins->b = b;
+    ins->c = c;
+    p->lines[p->length] = line;
+    return p->length++;
+}
+
+// Take the next temporary slot
+int push_temp(bytecode *p)
+{
+    int slot = p->variables + temps_used++;
+    if (temps_used > p->temporaries)
+        p->temporaries = temps_used;
+    return slot;
+}
+
+// Operand of a literal, -(constant index + 1) until compile_program places the constants.
+// Literals with the same bits share a slot, whatever their type.
+int constant(bytecode *p, value v)
+{
+    if (2 * (p->constant_count + 1) > constant_table_size)
+    {
+        free(constant_table);
+        constant_table_size = constant_table_size ? 2 * constant_table_size : 256;
+        constant_table = (int *)calloc(constant_table_size, sizeof(int));
+        for (int k = 0; k < p->constant_count; k++)
+        {
+            unsigned i = (unsigned)p->constants[k].integer * 2654435761u & (constant_table_size - 1);
+            while (constant_table[i])
+                i = (i + 1) & (constant_table_size - 1);
+            constant_table[i] = k + 1;
+        }
+    }
+
+    unsigned i = (unsigned)v.integer * 2654435761u & (constant_table_size - 1);
+    for (; constant_table[i]; i = (i + 1) & (constant_table_size - 1))
+        if (p->constants[constant_table[i] - 1].integer == v.integer)
+            return -constant_table[i];
+
+    if (p->constant_count == p->constant_capacity)
+        p->constants = (value *)grow_array(p->constants, &p->constant_capacity, sizeof(value));
+    p->constants[p->constant_count++] = v;
+    constant_table[i] = p->constant_count;
+    return -p->constant_count;
+}
+
+// Operand holding the value of an expression; the operator at its root writes to target unless it is -1
+int compile_expression(bytecode *p, ast_node *node, int target)
+{
+    static const int ops[2][4] = {{OP_ADD_I, OP_SUB_I, OP_MUL_I, OP_DIV_I}, {OP_ADD_R, OP_SUB_R, OP_MUL_R, OP_DIV_R}};
+    value v;
+    switch (node->kind)
+    {
+    case AST_INT:
+        v.integer = node->integer;
+        return constant(p, v);
+    case AST_REAL:
+        v.real = node->real;
+        return constant(p, v);
+    case AST_VAR:
+        return node->sym->index;
+    }
+
+    // the temporaries of both operands are free again once the operator has read them
+    int mark = temps_used;
+    int left = compile_expression(p, node->binary.left, -1);
+    int right = compile_expression(p, node->binary.right, -1);
+    temps_used = mark;
+    if (target < 0)
+        target = push_temp(p);
+    emit(p, ops[node->type][node->kind - AST_ADD], target, left, right, node->line);
+    return target;
+}
+
+// Compute an expression into a given slot
+void compile_into(bytecode *p, ast_node *node, int target)
+{
+    int slot = compile_expression(p, node, target);
+    if (slot != target)
+        emit(p, OP_MOVE, target, slot, 0, node->line);
+}
+
+void compile_statement(bytecode *p, ast_node *node)
+{
+    switch (node->kind)
+    {
+    case AST_LIST:
+        for (ast_node *stmt = node->list.first; stmt != NULL; stmt = stmt->next)
+            compile_statement(p, stmt);
+        break;
+    case AST_ASSIGN:
+        compile_into(p, node->assign.value, node->assign.sym->index);
+        break;
+    case AST_READ:
+        for (ast_node *var = node->decl.vars->list.first; var != NULL; var = var->next)
+            emit(p, var->type == 0 ? OP_READ_I : OP_READ_R, var->sym->index, 0, 0, node->line);
+        break;
+    case AST_WRITE:
+        for (ast_node *var = node->decl.vars->list.first; var != NULL; var = var->next)
+            emit(p, var->type == 0 ? OP_WRITE_I : OP_WRITE_R, var->sym->index, var != node->decl.vars->list.first, 0, node->line);
+        emit(p, OP_WRITE_LINE, 0, 0, 0, node->line);
+        break;
+    case AST_FOR:
+    {
+        // the bounds are kept in consecutive temporaries for the whole loop
+        int mark = temps_used;
+        int bounds = push_temp(p);
+        push_temp(p);
+        if (node->type == 1)
+            push_temp(p);
+        compile_into(p, node->loop.from, bounds);
+        compile_into(p, node->loop.to, bounds + 1);
+        int enter = emit(p, node->type == 0 ? OP_FOR_I_ENTER : OP_FOR_R_ENTER, node->loop.sym->index, bounds, 0, node->line);
+        int body = p->length;
+        compile_statement(p, node->loop.body);
+        emit(p, node->type == 0 ? OP_FOR_I_NEXT : OP_FOR_R_NEXT, node->loop.sym->index, bounds, body, node->line);
+        p->code[enter].c = p->length;
+        temps_used = mark;
+        break;
+    }
+    }
+}
+
+// Compile a checked program without errors
+bytecode *compile_program(ast_node *program)
+{
+    bytecode *p = (bytecode *)calloc(1, sizeof(bytecode));
+    p->variables = symbol_count;
+    temps_used = 0;
+    compile_statement(p, program->program.body);
+    emit(p, OP_HALT, 0, 0, 0, 0);
+
+    // the constants go after the temporaries
+    int base = p->variables + p->temporaries;
+    for (int i = 0; i < p->length; i++)
+    {
+        instruction *ins = &p->code[i];
+        if (ins->a < 0)
+            ins->a = base - ins->a - 1;
+        if (ins->b < 0)
+            ins->b = base - ins->b - 1;
+        if (ins->c < 0)
+            ins->c = base - ins->c - 1;
+    }
+    p->slots = base + p->constant_count;
+
+    free(constant_table);
+    constant_table = NULL;
+    constant_table_size = 0;
+    return p;
+}
+
+void free_bytecode(bytecode *p)
+{
+    free(p->code);
+    free(p->lines);
+    free(p->constants);
+    free(p);
+}
+
+/* Buffered input and output */
+
+#define IO_BUFFER (1 << 16)
+
+char input[IO_BUFFER + 1];
+int input_pos = 0, input_length = 0, input_end = 0;
+char output[IO_BUFFER];
+int output_length = 0;
+
+void flush_output()
+{
+    fwrite(output, 1, output_length, stdout);
+    fflush(stdout);
+    output_length = 0;
+}
+
+// Keep at least 64 bytes ahead of input_pos unless stdin has ended, so a number is never cut
+void refill_input()
+{
+    if (input_end || input_length - input_pos >= 64)
+        return;
+    memmove(input, input + input_pos, input_length - input_pos);
+    input_length -= input_pos;
+    input_pos = 0;
+    while (!input_end && input_length < IO_BUFFER)
+    {
+        size_t n = fread(input + input_length, 1, IO_BUFFER - input_length, stdin);
+        if (n == 0)
+            input_end = 1;
+        input_length += n;
+    }
+    input[input_length] = '\0';
+}
+
+// Skip blanks before a number, returns 0 at the end of the input
+int skip_blanks()
+{
+    for (;;)
+    {
+        refill_input();
+        if (input_pos == input_length)
+            return 0;
+        char c = input[input_pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '\v' && c != '\f')
+            return 1;
+        input_pos++;
+    }
+}
+
+// Read an optionally signed integer like scanf("%d")
+int read_integer(int *result)
+{
+    if (!skip_blanks())
+        return 0;
+    int pos = input_pos, negative = 0;
+    if (input[pos] == '-' || input[pos] == '+')
+        negative = input[pos++] == '-';
+    if (input[pos] < '0' || input[pos] > '9')
+        return 0;
+    unsigned value = 0;
+    while (input[pos] >= '0' && input[pos] <= '9')
+    {
+        value = value * 10 + (input[pos++] - '0');
+        if (pos == input_length)
+        {
+            // a long number reached the end of the buffer
+            input_pos = pos;
+            refill_input();
+            pos = input_pos;
+        }
+    }
+    input_pos = pos;
+    *result = (int)(negative ? 0u - value : value);
+    return 1;
+}
+
+int read_real(float *result)
+{
+    if (!skip_blanks())
+        return 0;
+    char *end;
+    *result = strtof(input + input_pos, &end);
+    if (end == input + input_pos)
+        return 0;
+    input_pos = end - input;
+    return 1;
+}
+
+void write_integer(int value, int space)
+{
+    if (output_length > IO_BUFFER - 16)
+        flush_output();
+    if (space)
+        output[output_length++] = ' ';
+    char digits[12];
+    int n = 0;
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do
+    {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0)
+        output[output_length++] = '-';
+    while (n)
+        output[output_length++] = digits[--n];
+}
+
+void write_real(float value, int space)
+{
+    if (output_length > IO_BUFFER - 64)
+        flush_output();
+    output_length += snprintf(output + output_length, 64, space ? " %g" : "%g", value);
+}
+
+/* Interpreter */
+
+void vm_error(bytecode *p, instruction *pc, const char *message)
+{
+    flush_output();
+    fprintf(stderr, "error: %s runtime error, line number: %d\n", message, p->lines[pc - p->code] + 1);
+    exit(1);
+}
+
+// Run a compiled program; the variables start from and end in their symbols
+void run_bytecode(bytecode *p)
+{
+    value *slots = (value *)calloc(p->slots, sizeof(value));
+    for (int i = 0; i < SIZE; i++)
+        for (symbol *sym = SYMTAB[i]; sym != NULL; sym = sym->next)
+        {
+            if (sym->type == 'F')
+                slots[sym->index].real = sym->real;
+            else
+                slots[sym->index].integer = sym->integer;
+        }
+    memcpy(slots + p->variables + p->temporaries, p->constants, p->constant_count * sizeof(value));
+
+    instruction *pc = p->code;
+#ifdef THREADED
+    static void *labels[] = {
+        [OP_MOVE] = &&L_OP_MOVE, [OP_ADD_I] = &&L_OP_ADD_I, [OP_SUB_I] = &&L_OP_SUB_I, [OP_MUL_I] = &&L_OP_MUL_I,
+        [OP_DIV_I] = &&L_OP_DIV_I, [OP_ADD_R] = &&L_OP_ADD_R, [OP_SUB_R] = &&L_OP_SUB_R, [OP_MUL_R] = &&L_OP_MUL_R,
+        [OP_DIV_R] = &&L_OP_DIV_R, [OP_READ_I] = &&L_OP_READ_I, [OP_READ_R] = &&L_OP_READ_R, [OP_WRITE_I] = &&L_OP_WRITE_I,
+        [OP_WRITE_R] = &&L_OP_WRITE_R, [OP_WRITE_LINE] = &&L_OP_WRITE_LINE, [OP_FOR_I_ENTER] = &&L_OP_FOR_I_ENTER,
+        [OP_FOR_I_NEXT] = &&L_OP_FOR_I_NEXT, [OP_FOR_R_ENTER] = &&L_OP_FOR_R_ENTER, [OP_FOR_R_NEXT] = &&L_OP_FOR_R_NEXT,
+        [OP_HALT] = &&L_OP_HALT};
+#define DISPATCH() goto *labels[pc->op]
+#define OP(name) L_##name:
+    DISPATCH();
+#else
+#define DISPATCH() continue
+#define OP(name) case name:
+    for (;;)
+        switch (pc->op)
+        {
+#endif
+
+    OP(OP_MOVE)
+        slots[pc->a] = slots[pc->b];
+        pc++;
+        DISPATCH();
+    OP(OP_ADD_I)
+        slots[pc->a].integer = (int)((unsigned)slots[pc->b].integer + (unsigned)slots[pc->c].integer);
+        pc++;
+        DISPATCH();
+    OP(OP_SUB_I)
+        slots[pc->a].integer = (int)((unsigned)slots[pc->b].integer - (unsigned)slots[pc->c].integer);
+        pc++;
+        DISPATCH();
+    OP(OP_MUL_I)
+        slots[pc->a].integer = (int)((unsigned)slots[pc->b].integer * (unsigned)slots[pc->c].integer);
+        pc++;
+        DISPATCH();
+    OP(OP_DIV_I)
+    {
+        int left = slots[pc->b].integer, right = slots[pc->c].integer;
+        if (right == 0)
+            vm_error(p, pc, "division by zero");
+        slots[pc->a].integer = right == -1 ? (int)(0u - (unsigned)left) : left / right;
+        pc++;
+        DISPATCH();
+    }
+    OP(OP_ADD_R)
+        slots[pc->a].real = slots[pc->b].real + slots[pc->c].real;
+        pc++;
+        DISPATCH();
+    OP(OP_SUB_R)
+        slots[pc->a].real = slots[pc->b].real - slots[pc->c].real;
+        pc++;
+        DISPATCH();
+    OP(OP_MUL_R)
+        slots[pc->a].real = slots[pc->b].real * slots[pc->c].real;
+        pc++;
+        DISPATCH();
+    OP(OP_DIV_R)
+        if (slots[pc->c].real == 0)
+            vm_error(p, pc, "division by zero");
+        slots[pc->a].real = slots[pc->b].real / slots[pc->c].real;
+        pc++;
+        DISPATCH();
+    OP(OP_READ_I)
+        if (!read_integer(&slots[pc->a].integer))
+            vm_error(p, pc, "missing input for READ");
+        pc++;
+        DISPATCH();
+    OP(OP_READ_R)
+        if (!read_real(&slots[pc->a].real))
+            vm_error(p, pc, "missing input for READ");
+        pc++;
+        DISPATCH();
+    OP(OP_WRITE_I)
+        write_integer(slots[pc->a].integer, pc->b);
+        pc++;
+        DISPATCH();
+    OP(OP_WRITE_R)
+        write_real(slots[pc->a].real, pc->b);
+        pc++;
+        DISPATCH();
+    OP(OP_WRITE_LINE)
+        if (output_length == IO_BUFFER)
+            flush_output();
+        output[output_length++] = '\n';
+        pc++;
+        DISPATCH();
+    OP(OP_FOR_I_ENTER)
+        if (slots[pc->b].integer > slots[pc->b + 1].integer)
+            pc = p->code + pc->c;
+        else
+        {
+            slots[pc->a].integer = slots[pc->b].integer;
+            pc++;
+        }
+        DISPATCH();
+    OP(OP_FOR_I_NEXT)
+        // compare before counting up, so a limit of INT_MAX does not overflow
+        if (slots[pc->b].integer < slots[pc->b + 1].integer)
+        {
+            slots[pc->a].integer = ++slots[pc->b].integer;
+            pc = p->code + pc->c;
+        }
+        else
+            pc++;
+        DISPATCH();
+    OP(OP_FOR_R_ENTER)
+        slots[pc->b + 2].integer = 0;
+        if ((double)slots[pc->b].real > (double)slots[pc->b + 1].real)
+            pc = p->code + pc->c;
+        else
+        {
+            slots[pc->a].real = slots[pc->b].real;
+            pc++;
+        }
+        DISPATCH();
+    OP(OP_FOR_R_NEXT)
+    {
+        // the index is from + iterations in double precision, as the tree evaluator computes it
+        double next = (double)slots[pc->b].real + slots[pc->b + 2].integer + 1;
+        if (next <= (double)slots[pc->b + 1].real)
+        {
+            slots[pc->b + 2].integer++;
+            slots[pc->a].real = (float)next;
+            pc = p->code + pc->c;
+        }
+        else
+            pc++;
+        DISPATCH();
+    }
+    OP(OP_HALT)
+        goto halt;
+
+#ifndef THREADED
+        }
+#endif
+#undef DISPATCH
+#undef OP
+
+halt:
+    flush_output();
+    for (int i = 0; i < SIZE; i++)
+        for (symbol *sym = SYMTAB[i]; sym != NULL; sym = sym->next)
+        {
+            if (sym->type == 'F')
+                sym->real = slots[sym->index].real;
+            else
+                sym->integer = slots[sym->index].integer;
+        }
+    free(slots);
+}
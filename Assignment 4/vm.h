@@ -0,0 +1,70 @@
+#ifndef VM_H
+#define VM_H
+
+/* header files */
+#include "ast.h"
+
+/*
+ * Register bytecode for checked programs. Every operand is a slot in one flat
+ * array of 32-bit values: first the variables, indexed by symbol->index, then
+ * the temporaries of expressions and loops, then the literals. An assignment
+ * such as X := Y + 1 is a single ADD_I X, Y, <1>, with no loads or stores.
+ *
+ * The interpreter dispatches with computed goto (threaded code) under GCC and
+ * clang, or with a switch when compiled with -DVM_SWITCH or by other compilers.
+ * READ and WRITE go through 64 KB buffers instead of scanf and printf.
+ */
+
+typedef enum opcode
+{
+    OP_MOVE,                   // a = b
+    OP_ADD_I,                  // a = b + c, integers wrap around
+    OP_SUB_I,
+    OP_MUL_I,
+    OP_DIV_I,                  // a = b DIV c, runtime error if c is 0
+    OP_ADD_R,                  // a = b + c on reals
+    OP_SUB_R,
+    OP_MUL_R,
+    OP_DIV_R,
+    OP_READ_I,                 // read an integer into a
+    OP_READ_R,                 // read a real into a
+    OP_WRITE_I,                // write integer a, after a space if b is 1
+    OP_WRITE_R,                // write real a, after a space if b is 1
+    OP_WRITE_LINE,             // end the line of a WRITE
+    OP_FOR_I_ENTER,            // b = counter, b + 1 = limit: jump to c if the loop runs 0 times, else a = counter
+    OP_FOR_I_NEXT,             // if counter < limit: a = ++counter and jump to c
+    OP_FOR_R_ENTER,            // b = from, b + 1 = to, b + 2 = iterations: like FOR_I_ENTER on reals
+    OP_FOR_R_NEXT,             // if from + iterations + 1 <= to: a = from + ++iterations and jump to c
+    OP_HALT
+} opcode;
+
+typedef struct instruction
+{
+    int op;                    // opcode
+    int a, b, c;               // slots, or a jump target for c
+} instruction;
+
+typedef union value
+{
+    int integer;
+    float real;
+} value;
+
+typedef struct bytecode
+{
+    instruction *code;         // instructions, ending with OP_HALT
+    int *lines;                // source line of every instruction, for runtime errors
+    int length, capacity;
+    value *constants;          // literals, copied behind the temporaries when the program runs
+    int constant_count, constant_capacity;
+    int variables;             // slots 0 .. variables - 1 hold the symbols
+    int temporaries;           // slots for expressions and loop bounds
+    int slots;                 // variables + temporaries + constant_count
+} bytecode;
+
+/* Function prototypes */
+bytecode *compile_program(ast_node *program);  // Compile a tree without errors
+void run_bytecode(bytecode *program);           // Run it, values end up in the symbols
+void free_bytecode(bytecode *program);          // Release the bytecode
+
+#endif /* VM_H */